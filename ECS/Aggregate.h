@@ -0,0 +1,76 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/chunk.h>
+
+namespace ECS {
+    //=================================================================================================================
+    // Aggregate
+    // Per chunk summary of one column. It is computed on first use and kept in the chunk until the column's
+    // change version moves on or a writable ComponentLookup access drops it, since the lookup only stamps a new
+    // version once per query run. Writes through raw pointers (Engine::Accept, Collector refs) do neither, so go
+    // through Query or ComponentLookup.
+    //=================================================================================================================
+    template<typename T, auto Field>
+    struct MinMax {
+        using Component = T;
+        using Value     = std::remove_cvref_t<decltype(std::declval<const T&>().*Field)>;
+
+        Value min{};
+        Value max{};
+
+        [[nodiscard]] static MinMax Reduce(std::span<const T> column) noexcept {
+            if (column.empty()) {
+                return {};
+            }
+
+            MinMax result{ column.front().*Field, column.front().*Field };
+            for (const auto& each : column.subspan(1)) {
+                result.min = Min(result.min, each.*Field);
+                result.max = Max(result.max, each.*Field);
+            }
+            return result;
+        }
+
+    private:
+        __inline static Value Min(const Value& lhs, const Value& rhs) noexcept {
+            if constexpr (std::is_arithmetic_v<Value>) {
+                return std::min(lhs, rhs);
+            }
+            else {
+                return glm::min(lhs, rhs);
+            }
+        }
+
+        __inline static Value Max(const Value& lhs, const Value& rhs) noexcept {
+            if constexpr (std::is_arithmetic_v<Value>) {
+                return std::max(lhs, rhs);
+            }
+            else {
+                return glm::max(lhs, rhs);
+            }
+        }
+    };
+
+    // AABB of a vector field : min/max are the corners.
+    template<typename T, auto Field>
+    using Bounds = MinMax<T, Field>;
+
+    template<typename Aggregate>
+    [[nodiscard]] const Aggregate& GetAggregate(const BodyHandler& handler) {
+        using Component = typename Aggregate::Component;
+        static_assert(std::is_trivially_copyable_v<Aggregate>, "Aggregates are cached as bytes.");
+
+        const auto hash = TypeHash<Aggregate>();
+        const auto columnHash = TypeHash<Component>();
+        const auto version = handler.GetChangeVersion(columnHash);
+        if (const auto* cached = handler.FindAggregate(hash, version)) {
+            return *reinterpret_cast<const Aggregate*>(cached);
+        }
+
+        const auto* column = reinterpret_cast<const Component*>(handler.Read(columnHash));
+        const auto result = Aggregate::Reduce(std::span<const Component>{ column, static_cast<size_t>(nullptr == column ? 0 : handler.GetAllocCount()) });
+        return *reinterpret_cast<const Aggregate*>(handler.StoreAggregate(hash, columnHash, version, reinterpret_cast<const uint8_t*>(&result), sizeof(Aggregate)));
+    }
+}
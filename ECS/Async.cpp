@@ -0,0 +1,59 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#include <pch.h>
+#include "async.h"
+
+namespace ECS {
+    void Scheduler::Start(AsyncTask&& task) {
+        if (false == task.IsDone()) {
+            _tasks.emplace_back(std::move(task));
+        }
+    }
+
+    void Scheduler::RunFrame() {
+        for (const auto& task : _tasks) {
+            task._handle.promise().isNextFrame = false;
+        }
+
+        while (true) {
+            bool      isResumed = false;
+            JobHandle pending;
+
+            // By index, a task may Start another one and grow _tasks while it runs.
+            for (size_t i = 0; i < _tasks.size(); ++i) {
+                const auto handle = _tasks[i]._handle;
+                auto& promise = handle.promise();
+                if (handle.done() || promise.isNextFrame) {
+                    continue;
+                }
+
+                if (nullptr != promise.awaiting && false == promise.awaiting->IsDone()) {
+                    pending = nullptr == pending ? promise.awaiting : pending;
+                    continue;
+                }
+
+                promise.awaiting = nullptr;
+                handle.resume();
+                isResumed = true;
+
+                if (nullptr != promise.exception) {
+                    std::rethrow_exception(std::exchange(promise.exception, nullptr));
+                }
+            }
+
+            std::erase_if(_tasks, [](const AsyncTask& task) { return task.IsDone(); });
+
+            if (isResumed) {
+                continue;
+            }
+            if (nullptr == pending) {
+                return;
+            }
+
+            // Help with any group, then look again; only block when every batch left is already running.
+            if (false == _jobs.RunBatch()) {
+                _jobs.Wait(pending);
+            }
+        }
+    }
+}
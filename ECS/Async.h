@@ -0,0 +1,97 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/job.h>
+
+namespace ECS {
+    // co_await NextFrame{} parks a task until the next Scheduler::RunFrame.
+    struct NextFrame {
+    };
+
+    //=================================================================================================================
+    // AsyncTask
+    // Coroutine return type of async systems. co_await on a JobHandle suspends the system until those jobs are
+    // done, co_await NextFrame{} until the next frame. It starts suspended and only a Scheduler resumes it, always
+    // on the scheduler's thread, so the code between awaits never runs beside another system's.
+    //=================================================================================================================
+    class AsyncTask {
+    public:
+        struct promise_type {
+            JobHandle          awaiting;
+            bool               isNextFrame = false;
+            std::exception_ptr exception;
+
+            AsyncTask get_return_object() noexcept { return AsyncTask{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            std::suspend_always final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+            auto await_transform(JobHandle handle) noexcept {
+                struct Awaiter {
+                    promise_type& promise;
+                    JobHandle     handle;
+
+                    bool await_ready() const noexcept { return handle->IsDone(); }
+                    void await_suspend(std::coroutine_handle<>) noexcept { promise.awaiting = std::move(handle); }
+                    void await_resume() const noexcept {}
+                };
+                return Awaiter{ *this, std::move(handle) };
+            }
+
+            auto await_transform(NextFrame) noexcept {
+                isNextFrame = true;
+                return std::suspend_always{};
+            }
+        };
+
+        AsyncTask(const AsyncTask&)            = delete;
+        AsyncTask& operator=(const AsyncTask&) = delete;
+        AsyncTask(AsyncTask&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {
+        }
+        AsyncTask& operator=(AsyncTask&& other) noexcept {
+            std::swap(_handle, other._handle);
+            return *this;
+        }
+        ~AsyncTask() {
+            if (nullptr != _handle) {
+                _handle.destroy();
+            }
+        }
+
+        [[nodiscard]] bool IsDone() const noexcept { return nullptr == _handle || _handle.done(); }
+
+    private:
+        friend class Scheduler;
+
+        explicit AsyncTask(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle) {
+        }
+
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+    //=================================================================================================================
+    // Scheduler
+    // Drives AsyncTasks through a frame. Every task started is resumed in turn, so while one waits on its jobs the
+    // next one schedules its own and the workers see both; the calling thread runs batches instead of blocking.
+    // A task that awaits NextFrame keeps its state and jobs in flight across frames, which pipelines long work
+    // behind the rest of the frame.
+    //=================================================================================================================
+    class Scheduler {
+    public:
+        explicit Scheduler(JobSystem& jobs) : _jobs(jobs) {
+        }
+
+        void                            Start(AsyncTask&& task);
+        // Returns once every task is done or waits for the next frame. An exception a task threw is rethrown here.
+        void                            RunFrame();
+
+        [[nodiscard]] constexpr JobSystem& GetJobSystem() const noexcept { return _jobs; }
+        [[nodiscard]] size_t            GetNumTasks() const noexcept { return _tasks.size(); }
+
+    private:
+        JobSystem&                      _jobs;
+        std::vector<AsyncTask>          _tasks;
+    };
+}
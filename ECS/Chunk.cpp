@@ -7,74 +7,360 @@ namespace Chunk {
     //=================================================================================================================
     // TypeInfo
     //=================================================================================================================
-    TypeInfo::TypeInfo(const HashSizePairs& types) {
+    TypeInfo::TypeInfo(const HashSizePairs& types, const HeaderDesc& header) {
         for (const auto& [hash, size] : types) {
+            if (0 == size) {
+                _tags.emplace_back(hash);
+                continue;
+            }
+
             _types.emplace_back(hash, size, _totalSize);
             _totalSize += size;
         }
+
+        for (const auto& [hash, size] : header.shared) {
+            _headerTypes.emplace_back(hash, size, _headerSize);
+            _headerSize += size;
+        }
+        _sharedSize = _headerSize;
+
+        for (const auto& [hash, size] : header.chunk) {
+            _headerTypes.emplace_back(hash, size, _headerSize);
+            _headerSize += size;
+        }
     }
 
     bool TypeInfo::IsHas(Hash hash) const noexcept {
+        const auto isHash = [hash](const auto& eachType)->bool {
+            return eachType.hash == hash;
+        };
+        return IsTag(hash) || std::ranges::any_of(_types, isHash) || std::ranges::any_of(_headerTypes, isHash);
+    }
+
+    bool TypeInfo::IsShared(Hash hash) const noexcept {
+        return std::ranges::any_of(_headerTypes, [this, hash](const auto& eachType)->bool {
+            return eachType.hash == hash && eachType.offset < _sharedSize;
+        });
+    }
+
+    bool TypeInfo::IsColumn(Hash hash) const noexcept {
         return std::ranges::any_of(_types, [hash](const auto& eachType)->bool {
             return eachType.hash == hash;
         });
     }
 
+    bool TypeInfo::IsTag(Hash hash) const noexcept {
+        return std::ranges::find(_tags, hash) != _tags.end();
+    }
+
     //=================================================================================================================
     // BodyHandler
     //=================================================================================================================
-    BodyHandler::BodyHandler(Size packCount, const Types& types) : _packCount(packCount) {
-        for (const auto& [hash, size, offset] : types) {
+    BodyHandler::BodyHandler(Size packCount, const TypeInfo& typeInfo, SharedKey shared)
+        : _packCount(packCount)
+        , _sharedSize(typeInfo.GetSharedSize())
+        , _header(typeInfo.GetHeaderSize(), 0)
+        , _body(std::make_shared<Body>()) {
+        for (const auto& [hash, size, offset] : typeInfo.GetTypes()) {
             _types.try_emplace(hash, std::pair{ size, offset });
+            _changeVersions.try_emplace(hash, 0);
+        }
+
+        // Tags have no column but can be disabled per row, their version records that.
+        for (const auto hash : typeInfo.GetTags()) {
+            _changeVersions.try_emplace(hash, 0);
+        }
+
+        for (const auto& [hash, size, offset] : typeInfo.GetHeaderTypes()) {
+            _headerTypes.try_emplace(hash, std::pair{ size, offset });
         }
+        std::ranges::copy(shared.first(std::min<size_t>(shared.size(), _sharedSize)), _header.begin());
     }
 
-    BodyIndex BodyHandler::Allocate() const {
+    gsl::owner<BodyHandler*> BodyHandler::Fork() const {
+        return new BodyHandler{ *this };
+    }
+
+    BodyIndex BodyHandler::Allocate(Entity entity) const {
         if (IsFull()) {
             return InvalidBodyIndex;
         }
 
+        Detach();
+        _aggregates.clear();
+        reinterpret_cast<Entity*>(_body->memory)[_allocCount] = entity;
         return _allocCount++;
     }
 
-    void BodyHandler::Free(BodyIndex index) const {
+    Entity BodyHandler::Free(BodyIndex index) const {
         if (index >= _allocCount || InvalidBodyIndex == index) {
-            return;
+            return InvalidEntity;
         }
 
+        Detach();
+        _aggregates.clear();
         --_allocCount;
         if (index == _allocCount || IsEmpty()) {
-            return;
+            EnableRow(index);
+            return InvalidEntity;
         }
 
+        auto* entities = reinterpret_cast<Entity*>(_body->memory);
+        entities[index] = entities[_allocCount];
+
         for (const auto& [size, offset] : std::views::values(_types)) {
             const auto start = offset * _packCount;
-            const auto& src = _body.memory[start + size * _allocCount];
-            auto& dest = _body.memory[start + size * index];
+            const auto& src = _body->memory[start + size * _allocCount];
+            auto& dest = _body->memory[start + size * index];
             memcpy_s(&dest, size, &src, size);
         }
+
+        for (auto& [bits, numDisabled] : std::views::values(_enableMasks)) {
+            auto& destWord = bits[index / EnableWordBits];
+            auto& srcWord = bits[_allocCount / EnableWordBits];
+            const auto destBit = uint64_t{ 1 } << (index % EnableWordBits);
+            const auto srcBit = uint64_t{ 1 } << (_allocCount % EnableWordBits);
+
+            numDisabled -= 0 == (destWord & destBit) ? 1 : 0;
+            destWord = 0 == (srcWord & srcBit) ? destWord & ~destBit : destWord | destBit;
+            srcWord |= srcBit;
+        }
+        return entities[index];
     }
 
     BodyRefs BodyHandler::Get(BodyIndex index, const Hashes& hashes) const {
+        Detach();
+
         BodyRefs result;
         for (const auto hash : hashes) {
             const auto& [size, offset] = _types[hash];
-            result.emplace_back(&_body.memory[offset * _packCount + size * index]);
+            result.emplace_back(&_body->memory[offset * _packCount + size * index]);
         }
         return result;
     }
 
     BodyRef BodyHandler::Get(BodyIndex index, Hash hash) const {
+        Detach();
         const auto& [size, offset] = _types[hash];
-        return &_body.memory[offset * _packCount + size * index];
+        return &_body->memory[offset * _packCount + size * index];
     }
 
     BodyRef BodyHandler::Get(Hash hash) const {
+        Detach();
         const auto& [size, offset] = _types[hash];
-        return &_body.memory[offset * _packCount];
+        return &_body->memory[offset * _packCount];
+    }
+
+    BodyRef BodyHandler::Find(Hash hash) const {
+        if (false == _types.contains(hash)) {
+            return nullptr;
+        }
+
+        Detach();
+        return const_cast<BodyRef>(Read(hash));
+    }
+
+    const uint8_t* BodyHandler::Read(Hash hash) const noexcept {
+        const auto findIterator = _types.find(hash);
+        if (_types.end() == findIterator) {
+            return nullptr;
+        }
+
+        const auto& [size, offset] = findIterator->second;
+        return &_body->memory[offset * _packCount];
+    }
+
+    void BodyHandler::Prefetch(Hash hash) const noexcept {
+        const auto findIterator = _types.find(hash);
+        if (_types.end() == findIterator) {
+            return;
+        }
+
+        const auto& [size, offset] = findIterator->second;
+        const auto* column = &_body->memory[offset * _packCount];
+        for (size_t line = 0; line < static_cast<size_t>(size) * _allocCount; line += CacheLineSize) {
+            _mm_prefetch(reinterpret_cast<const char*>(column + line), _MM_HINT_T0);
+        }
     }
 
     void BodyHandler::Clear() const {
         _allocCount = 0;
+        _enableMasks.clear();
+        _aggregates.clear();
+    }
+
+    ChangeVersion BodyHandler::GetChangeVersion(Hash hash) const noexcept {
+        const auto findIterator = _changeVersions.find(hash);
+        return _changeVersions.end() == findIterator ? 0 : findIterator->second;
+    }
+
+    void BodyHandler::MarkChanged(Hash hash, ChangeVersion version) const {
+        if (const auto findIterator = _changeVersions.find(hash);
+            _changeVersions.end() != findIterator) {
+            findIterator->second = version;
+        }
+    }
+
+    void BodyHandler::MarkChanged(ChangeVersion version) const {
+        for (auto& eachVersion : std::views::values(_changeVersions)) {
+            eachVersion = version;
+        }
+    }
+
+    void BodyHandler::CopyRow(BodyIndex index, uint8_t* row) const {
+        for (const auto& [size, offset] : std::views::values(_types)) {
+            memcpy_s(row + offset - EntityColumnSize, size, &_body->memory[offset * _packCount + size * index], size);
+        }
+    }
+
+    void BodyHandler::Replicate(BodyIndex start, Size count, const uint8_t* row) const {
+        if (0 == count) {
+            return;
+        }
+
+        Detach();
+        _aggregates.clear();
+        for (const auto& [size, offset] : std::views::values(_types)) {
+            auto* dest = &_body->memory[offset * _packCount + size * start];
+            memcpy_s(dest, size, row + offset - EntityColumnSize, size);
+
+            // Doubling copy : every pass copies everything written so far, so a column takes log2(count) memcpy.
+            for (Size filled = 1; filled < count;) {
+                const auto num = std::min<Size>(filled, count - filled);
+                memcpy_s(dest + size * filled, size * num, dest, size * num);
+                filled += num;
+            }
+        }
+    }
+
+    bool BodyHandler::IsEnabled(BodyIndex index, Hash hash) const noexcept {
+        const auto findIterator = _enableMasks.find(hash);
+        if (_enableMasks.end() == findIterator) {
+            return true;
+        }
+
+        return 0 != (findIterator->second.bits[index / EnableWordBits] & (uint64_t{ 1 } << (index % EnableWordBits)));
+    }
+
+    void BodyHandler::SetEnabled(BodyIndex index, Hash hash, bool isEnabled) const {
+        if (index >= _allocCount || (isEnabled && false == _enableMasks.contains(hash))) {
+            return;
+        }
+
+        auto& [bits, numDisabled] = _enableMasks[hash];
+        if (bits.empty()) {
+            bits.resize((_packCount + EnableWordBits - 1) / EnableWordBits, ~uint64_t{ 0 });
+        }
+
+        auto& word = bits[index / EnableWordBits];
+        const auto bit = uint64_t{ 1 } << (index % EnableWordBits);
+        if (isEnabled == (0 != (word & bit))) {
+            return;
+        }
+
+        word ^= bit;
+        isEnabled ? --numDisabled : ++numDisabled;
+    }
+
+    void BodyHandler::Detach() const {
+        if (1 == _body.use_count()) {
+            // The last fork may have let go on another thread, see its writes before writing in place.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return;
+        }
+        _body = std::make_shared<Body>(*_body);
+    }
+
+    void BodyHandler::EnableRow(BodyIndex index) const {
+        for (auto& [bits, numDisabled] : std::views::values(_enableMasks)) {
+            auto& word = bits[index / EnableWordBits];
+            const auto bit = uint64_t{ 1 } << (index % EnableWordBits);
+            if (0 == (word & bit)) {
+                word |= bit;
+                --numDisabled;
+            }
+        }
+    }
+
+    bool BodyHandler::GetEnableBits(const Hashes& hashes, EnableBits& bits) const {
+        auto isFiltered = false;
+        for (const auto hash : hashes) {
+            const auto findIterator = _enableMasks.find(hash);
+            if (_enableMasks.end() == findIterator || 0 == findIterator->second.numDisabled) {
+                continue;
+            }
+
+            const auto& maskBits = findIterator->second.bits;
+            if (false == isFiltered) {
+                bits.assign(maskBits.begin(), maskBits.end());
+                isFiltered = true;
+                continue;
+            }
+
+            for (size_t i = 0; i < bits.size(); ++i) {
+                bits[i] &= maskBits[i];
+            }
+        }
+        return isFiltered;
+    }
+
+    void BodyHandler::CopyEnabled(BodyIndex index, const BodyHandler& dest, BodyIndex destIndex) const {
+        for (const auto& [hash, mask] : _enableMasks) {
+            if (0 == (mask.bits[index / EnableWordBits] & (uint64_t{ 1 } << (index % EnableWordBits)))) {
+                dest.SetEnabled(destIndex, hash, false);
+            }
+        }
+    }
+
+    bool BodyHandler::IsShared(SharedKey shared) const noexcept {
+        const auto own = GetSharedKey();
+        if (shared.size() > own.size()) {
+            return false;
+        }
+
+        return std::ranges::equal(shared, own.first(shared.size()))
+            && std::ranges::all_of(own.subspan(shared.size()), [](const auto value)->bool { return 0 == value; });
+    }
+
+    const uint8_t* BodyHandler::FindShared(Hash hash) const noexcept {
+        const auto findIterator = _headerTypes.find(hash);
+        if (_headerTypes.end() == findIterator || findIterator->second.second >= _sharedSize) {
+            return nullptr;
+        }
+        return &_header[findIterator->second.second];
+    }
+
+    BodyRef BodyHandler::FindChunkComponent(Hash hash) const noexcept {
+        const auto findIterator = _headerTypes.find(hash);
+        if (_headerTypes.end() == findIterator || findIterator->second.second < _sharedSize) {
+            return nullptr;
+        }
+        return &_header[findIterator->second.second];
+    }
+
+    const uint8_t* BodyHandler::FindAggregate(Hash hash, ChangeVersion version) const noexcept {
+        const auto findIterator = _aggregates.find(hash);
+        if (_aggregates.end() == findIterator || version != findIterator->second.version) {
+            return nullptr;
+        }
+        return findIterator->second.bytes.data();
+    }
+
+    const uint8_t* BodyHandler::StoreAggregate(Hash hash, Hash column, ChangeVersion version, const uint8_t* bytes, size_t size) const {
+        auto& [cached, cachedColumn, cachedVersion] = _aggregates[hash];
+        cached.assign(bytes, bytes + size);
+        cachedColumn = column;
+        cachedVersion = version;
+        return cached.data();
+    }
+
+    void BodyHandler::DropAggregates(Hash column) const noexcept {
+        if (_aggregates.empty()) {
+            return;
+        }
+
+        std::erase_if(_aggregates, [column](const auto& each)->bool {
+            return column == each.second.column;
+        });
     }
 }
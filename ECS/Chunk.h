@@ -8,30 +8,63 @@ namespace Chunk {
     using namespace ECS;
 
     constexpr uint16_t ChunkSizeToByte = 16384; // 16KB
-    struct Body {
+    constexpr size_t   CacheLineSize   = 64;
+    struct alignas(CacheLineSize) Body {
         uint8_t        memory[ChunkSizeToByte]{};
     };
 
     //=================================================================================================================
     // TypeInfo
+    // Every chunk starts with an entity id column, component columns follow it. Size 0 types are tags, kept in
+    // the signature only. Header types are stored once per chunk : shared components split chunks by value,
+    // chunk components are free per chunk data.
     //=================================================================================================================
+    constexpr Size EntityColumnSize = static_cast<Size>(sizeof(Entity));
+
+    struct HeaderDesc {
+        HashSizePairs shared;
+        HashSizePairs chunk;
+    };
+
+    using SharedKey = std::span<const uint8_t>;
+
     class TypeInfo {
     public:
-        explicit TypeInfo(const HashSizePairs& types);
+        explicit TypeInfo(const HashSizePairs& types, const HeaderDesc& header = {});
 
         [[nodiscard]] bool                   IsHas(Hash hash) const noexcept;
+        [[nodiscard]] bool                   IsTag(Hash hash) const noexcept;
+        [[nodiscard]] bool                   IsShared(Hash hash) const noexcept;
+        // A per entity column, not a tag or a header type.
+        [[nodiscard]] bool                   IsColumn(Hash hash) const noexcept;
         [[nodiscard]] constexpr const Types& GetTypes() const noexcept { return _types; }
+        [[nodiscard]] constexpr const Hashes& GetTags() const noexcept { return _tags; }
+        [[nodiscard]] constexpr size_t       GetNumSignature() const noexcept { return _types.size() + _tags.size() + _headerTypes.size(); }
         [[nodiscard]] constexpr Size         GetTotalSize() const noexcept { return _totalSize; }
 
+        // Shared types come first in the header, so a chunk's shared key is [0, GetSharedSize()).
+        [[nodiscard]] constexpr const Types& GetHeaderTypes() const noexcept { return _headerTypes; }
+        [[nodiscard]] constexpr Size         GetSharedSize() const noexcept { return _sharedSize; }
+        [[nodiscard]] constexpr Size         GetHeaderSize() const noexcept { return _headerSize; }
+
     private:
-        Size                                 _totalSize = 0;
+        Size                                 _totalSize = EntityColumnSize;
         Types                                _types;
+        Hashes                               _tags;
+
+        Size                                 _sharedSize = 0;
+        Size                                 _headerSize = 0;
+        Types                                _headerTypes;
     };
 
     //=================================================================================================================
     // BodyHandler
+    // The body is shared with the handlers forked from it until one of them writes : every accessor handing out
+    // writable memory copies a shared body first, Read and GetEntities never do.
     //=================================================================================================================
     using     HashBySizeOffsetMap        = std::map<Hash, std::pair<Size, Size>>;
+    using     HashByChangeVersionMap     = std::map<Hash, ChangeVersion>;
+    using     EnableBits                 = std::vector<uint64_t>;
     using     BodyRef                    = uint8_t*;
     using     BodyRefs                   = std::vector<BodyRef>;
     using     BodyIndex                  = Size;
@@ -39,43 +72,144 @@ namespace Chunk {
 
     class BodyHandler {
     public:
-        explicit BodyHandler(Size packCount, const Types& types);
+        explicit BodyHandler(Size packCount, const TypeInfo& typeInfo, SharedKey shared = {});
+        BodyHandler(BodyHandler&&)                 = delete;
+        BodyHandler& operator=(const BodyHandler&) = delete;
+        BodyHandler& operator=(BodyHandler&&)      = delete;
+
+        // New handler with this one's rows and header, sharing the body copy on write.
+        [[nodiscard]] gsl::owner<BodyHandler*> Fork() const;
+        [[nodiscard]] bool           IsBodyShared() const noexcept { return 1 < _body.use_count(); }
+        // Identifies the memory the columns live in, it changes when a shared body is copied.
+        [[nodiscard]] const Body*    GetBody() const noexcept { return _body.get(); }
+        // Copies a body still shared with a fork. Callers taking several columns at once detach first, so read
+        // and written columns point into the same body.
+        void                         Detach() const;
 
         [[nodiscard]] constexpr bool IsFull() const noexcept { return _packCount == _allocCount; }
         [[nodiscard]] constexpr bool IsEmpty() const noexcept { return 0 == _allocCount; }
         [[nodiscard]] constexpr Size GetAllocCount() const noexcept { return _allocCount; }
         [[nodiscard]] constexpr Size GetPackCount() const noexcept { return _packCount; }
 
-        BodyIndex                    Allocate() const;
-        void                         Free(BodyIndex index) const;
+        BodyIndex                    Allocate(Entity entity) const;
+        Entity                       Free(BodyIndex index) const;
 
         BodyRefs                     Get(BodyIndex index, const Hashes& hashes) const;
         BodyRef                      Get(BodyIndex index, Hash hash) const;
         BodyRef                      Get(Hash hash) const;
+        [[nodiscard]] BodyRef        Find(Hash hash) const;
+        [[nodiscard]] const uint8_t* Read(Hash hash) const noexcept;
+        // Cache hint for every line of the column's live rows, issued ahead of a sweep.
+        void                         Prefetch(Hash hash) const noexcept;
+
+        [[nodiscard]] std::span<const Entity> GetEntities() const noexcept {
+            return { reinterpret_cast<const Entity*>(_body->memory), _allocCount };
+        }
 
         void                         Clear() const;
 
+        // Version of the last write access per column, compared against the version a query last ran at.
+        [[nodiscard]] ChangeVersion  GetChangeVersion(Hash hash) const noexcept;
+        void                         MarkChanged(Hash hash, ChangeVersion version) const;
+        void                         MarkChanged(ChangeVersion version) const;
+
+        // Row layout is the TypeInfo one without the entity column : offset - EntityColumnSize.
+        void                         CopyRow(BodyIndex index, uint8_t* row) const;
+        void                         Replicate(BodyIndex start, Size count, const uint8_t* row) const;
+
+        // One bit per row, set while enabled. A mask is only created on the first disable, rows past the alloc
+        // count stay set so allocation never touches it.
+        [[nodiscard]] bool           IsEnabled(BodyIndex index, Hash hash) const noexcept;
+        void                         SetEnabled(BodyIndex index, Hash hash, bool isEnabled) const;
+        // And of the masks of hashes into bits, false when every row is enabled and bits is left untouched.
+        bool                         GetEnableBits(const Hashes& hashes, EnableBits& bits) const;
+        void                         CopyEnabled(BodyIndex index, const BodyHandler& dest, BodyIndex destIndex) const;
+
+        // A shorter key is compared as if padded with zero, so an empty key means the default shared values.
+        [[nodiscard]] bool           IsShared(SharedKey shared) const noexcept;
+        [[nodiscard]] SharedKey      GetSharedKey() const noexcept { return { _header.data(), _sharedSize }; }
+        [[nodiscard]] const uint8_t* FindShared(Hash hash) const noexcept;
+        [[nodiscard]] BodyRef        FindChunkComponent(Hash hash) const noexcept;
+
+        // Summary bytes cached under hash, nullptr unless they were stored at version. Adding or removing rows drops
+        // them, since structural changes within one interval share a version.
+        [[nodiscard]] const uint8_t* FindAggregate(Hash hash, ChangeVersion version) const noexcept;
+        const uint8_t*               StoreAggregate(Hash hash, Hash column, ChangeVersion version, const uint8_t* bytes, size_t size) const;
+        // Drops the summaries of a column written without a new change version, see ComponentLookup.
+        void                         DropAggregates(Hash column) const noexcept;
+
     private:
-        const Size                  _packCount = 0;
-        mutable HashBySizeOffsetMap _types;
+        struct EnableMask {
+            EnableBits                 bits;
+            Size                       numDisabled = 0;
+        };
+        using HashByEnableMaskMap      = std::map<Hash, EnableMask>;
+
+        struct AggregateCache {
+            std::vector<uint8_t>       bytes;
+            Hash                       column = 0;
+            ChangeVersion              version = 0;
+        };
+        using HashByAggregateMap       = std::map<Hash, AggregateCache>;
 
-        mutable Body                _body;
-        mutable Size                _allocCount = 0;
+        BodyHandler(const BodyHandler&)            = default;
+
+        void                           EnableRow(BodyIndex index) const;
+
+        const Size                     _packCount = 0;
+        mutable HashBySizeOffsetMap    _types;
+        mutable HashByChangeVersionMap _changeVersions;
+        mutable HashByEnableMaskMap    _enableMasks;
+        mutable HashByAggregateMap     _aggregates;
+
+        const Size                     _sharedSize = 0;
+        HashBySizeOffsetMap            _headerTypes;
+        mutable std::vector<uint8_t>   _header;
+
+        mutable std::shared_ptr<Body>  _body;
+        mutable Size                   _allocCount = 0;
     };
 
-    template<typename T1>
-    T1* Accept(const BodyRefs& refs) {
-        return reinterpret_cast<T1*>(refs[0]);
+    //=================================================================================================================
+    // Enable bits
+    //=================================================================================================================
+    constexpr Size EnableWordBits = 64;
+
+    // First row in [from, count) whose bit equals value, count if none. Scans a word at a time.
+    [[nodiscard]] __inline Size FindEnableBit(const uint64_t* bits, Size from, Size count, bool value) noexcept {
+        while (from < count) {
+            const auto word = value ? bits[from / EnableWordBits] : ~bits[from / EnableWordBits];
+            if (const auto rest = word >> (from % EnableWordBits); 0 != rest) {
+                return std::min<Size>(count, from + static_cast<Size>(std::countr_zero(rest)));
+            }
+            from = (from / EnableWordBits + 1) * EnableWordBits;
+        }
+        return count;
     }
 
-    template<typename T1, typename T2, typename T3, typename T4, typename T5>
-    std::tuple<T1*, T2*, T3*, T4*, T5*> Accept(const BodyRefs& refs) {
-        return {
-            reinterpret_cast<T1*>(refs[0]),
-            reinterpret_cast<T2*>(refs[1]),
-            reinterpret_cast<T3*>(refs[2]),
-            reinterpret_cast<T4*>(refs[3]),
-            reinterpret_cast<T5*>(refs[4]),
-        };
+    // func(begin, end) for every run of set bits in [0, count).
+    template<typename Func>
+    void ForEachEnabledRun(const uint64_t* bits, Size count, Func&& func) {
+        for (auto begin = FindEnableBit(bits, 0, count, true); begin < count;) {
+            const auto end = FindEnableBit(bits, begin, count, false);
+            func(begin, end);
+            begin = FindEnableBit(bits, end, count, true);
+        }
+    }
+
+    template<typename... Ts, size_t... Indices>
+    std::tuple<Ts*...> AcceptIndices(const BodyRefs& refs, std::index_sequence<Indices...>) {
+        return { reinterpret_cast<Ts*>(refs[Indices])... };
+    }
+
+    template<typename... Ts>
+    auto Accept(const BodyRefs& refs) {
+        assert(sizeof...(Ts) <= refs.size());
+        if constexpr (1 == sizeof...(Ts)) {
+            return std::get<0>(AcceptIndices<Ts...>(refs, std::index_sequence_for<Ts...>{}));
+        }
+        else {
+            return AcceptIndices<Ts...>(refs, std::index_sequence_for<Ts...>{});
+        }
     }
 }
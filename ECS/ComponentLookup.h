@@ -0,0 +1,91 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/entity.h>
+
+namespace ECS {
+    //=================================================================================================================
+    // ComponentLookup
+    // Random access to one component type by entity id : id -> location -> cached column base of that chunk.
+    // Column pointers are cached per chunk along with the body they point into, and fetched again once a fork's
+    // copy on write moved the chunk to a new body. Build it again when chunks may have been released.
+    // A writable lookup marks the chunk changed on access, newer than any finished query run, so Changed<T>() sees it,
+    // and drops the chunk's cached aggregates of T, which that version alone would keep between two accesses.
+    //=================================================================================================================
+    template<typename T>
+    class ComponentLookup {
+        using Component     = std::remove_const_t<T>;
+
+        struct Column {
+            T*                 base = nullptr;
+            const Body*        body = nullptr;
+            ChangeVersion      stamp = 0;
+        };
+        using ColumnCache   = std::unordered_map<const BodyHandler*, Column>;
+
+    public:
+        explicit ComponentLookup(const Engine& engine) : _engine(engine) {
+        }
+
+        [[nodiscard]] bool Has(Entity entity) {
+            return nullptr != Get(entity);
+        }
+
+        [[nodiscard]] T* Get(Entity entity) {
+            const auto* location = _engine.GetLocation(entity);
+            if (nullptr == location) {
+                return nullptr;
+            }
+
+            auto* column = GetColumn(location->handler);
+            return nullptr == column ? nullptr : column + location->index;
+        }
+
+        [[nodiscard]] T& operator[](Entity entity) {
+            auto* component = Get(entity);
+            assert(nullptr != component);
+            return *component;
+        }
+
+    private:
+        T* GetColumn(const BodyHandler* handler) {
+            if constexpr (false == std::is_const_v<T>) {
+                // Written through later, so a body still shared with a fork is copied first.
+                handler->Detach();
+            }
+
+            auto* column = _lastHandler == handler ? _lastColumn : &_columns[handler];
+            if (column->body != handler->GetBody()) {
+                if constexpr (std::is_const_v<T>) {
+                    column->base = reinterpret_cast<T*>(handler->Read(_hash));
+                }
+                else {
+                    column->base = reinterpret_cast<T*>(handler->Find(_hash));
+                }
+                column->body = handler->GetBody();
+            }
+
+            if constexpr (false == std::is_const_v<T>) {
+                // Stamped again only once a query ran since, the previous stamp is still the newest until then.
+                if (const auto version = _engine.GetStructuralVersion();
+                    column->stamp != version) {
+                    handler->MarkChanged(_hash, version);
+                    column->stamp = version;
+                }
+                handler->DropAggregates(_hash);
+            }
+
+            _lastHandler = handler;
+            _lastColumn = column;
+            return column->base;
+        }
+
+        const Engine&      _engine;
+        const Hash         _hash = typeid(Component).hash_code();
+
+        const BodyHandler* _lastHandler = nullptr;
+        Column*            _lastColumn = nullptr;
+        ColumnCache        _columns;
+    };
+}
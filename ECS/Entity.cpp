@@ -10,10 +10,17 @@ namespace ECS {
     Instance::Instance(TypeInfo&& typeInfo)
         : _typeInfo(std::move(typeInfo))
         , _packCount(static_cast<Size>(ChunkSizeToByte / _typeInfo.GetTotalSize())) {
-        _bodyHandlers.emplace_back(new BodyHandler{ _packCount, _typeInfo.GetTypes() });
+        _bodyHandlers.emplace_back(new BodyHandler{ _packCount, _typeInfo });
         _currentHandler = _bodyHandlers.front();
     }
 
+    Instance::Instance(const TypeInfo& typeInfo, BodyHandlerOwners&& handlers, const BodyHandler* currentHandler)
+        : _typeInfo(typeInfo)
+        , _packCount(static_cast<Size>(ChunkSizeToByte / _typeInfo.GetTotalSize()))
+        , _currentHandler(currentHandler)
+        , _bodyHandlers(std::move(handlers)) {
+    }
+
     Instance::~Instance() {
         for (const auto* eachHandler : _bodyHandlers) {
             delete eachHandler;
@@ -34,25 +41,65 @@ namespace ECS {
         return isAnyFailed ? false : true;
     }
 
-    Collectors Instance::GenerateCollector(const Hashes& hashes) const {
+    bool Instance::IsHas(Hash hash) const {
+        return _typeInfo.IsHas(hash);
+    }
+
+    bool Instance::IsMatch(const QueryDesc& desc) const {
+        const auto isHas = [this](const auto hash)->bool {
+            return _typeInfo.IsHas(hash);
+        };
+        return IsType(desc.all)
+            && std::ranges::none_of(desc.none, isHas)
+            && (desc.any.empty() || std::ranges::any_of(desc.any, isHas))
+            && std::ranges::all_of(desc.columns, [this](const auto hash)->bool { return _typeInfo.IsColumn(hash); });
+    }
+
+    Collectors Instance::GenerateCollector(const Hashes& hashes, const Hashes& required) const {
         Collectors result;
+        EnableBits bits;
         for (const auto* handler : _bodyHandlers) {
-            result.emplace_back(handler, handler->GetAllocCount());
+            // Copied first, so the entities and refs point into the body that is written.
+            handler->Detach();
+
+            const auto entities = handler->GetEntities();
+            const auto collect = [&result, &hashes, handler, &entities](Size begin, Size end) {
+                auto& collector = result.emplace_back(handler, end - begin, entities.subspan(begin, end - begin));
+                for (const auto hash : hashes) {
+                    collector.refs.emplace_back(nullptr == handler->Find(hash) ? nullptr : handler->Get(begin, hash));
+                }
+            };
 
-            for (auto& collector = result.back();
-                const auto hash : hashes) {
-                collector.refs.emplace_back(handler->Get(hash));
+            if (handler->GetEnableBits(required, bits)) {
+                ForEachEnabledRun(bits.data(), handler->GetAllocCount(), collect);
+            }
+            else {
+                collect(0, handler->GetAllocCount());
             }
         }
         return result;
     }
 
+    Instance Instance::Fork() const {
+        BodyHandlerOwners handlers;
+        const BodyHandler* currentHandler = nullptr;
+        for (const auto* eachHandler : _bodyHandlers) {
+            handlers.emplace_back(eachHandler->Fork());
+            currentHandler = _currentHandler == eachHandler ? handlers.back() : currentHandler;
+        }
+        return Instance{ _typeInfo, std::move(handlers), currentHandler };
+    }
+
     const BodyHandler* Instance::FindHandler(const Hashes& hashes) {
         if(false == IsType(hashes)) {
             return nullptr;
         }
 
-        RefreshCurrentHandler();
+        return AcquireHandler();
+    }
+
+    const BodyHandler* Instance::AcquireHandler(SharedKey shared) {
+        RefreshCurrentHandler(shared);
         return _currentHandler;
     }
 
@@ -66,191 +113,397 @@ namespace ECS {
         _bodyHandlers.erase(removeRanges.begin(), removeRanges.end());
     }
 
-    void Instance::RefreshCurrentHandler() {
-        if (false == _currentHandler->IsFull()) {
+    void Instance::RefreshCurrentHandler(SharedKey shared) {
+        if (false == _currentHandler->IsFull() && _currentHandler->IsShared(shared)) {
             return;
         }
 
         for (const auto* eachHandler : _bodyHandlers) {
-            if (false == eachHandler->IsFull()) {
+            if (false == eachHandler->IsFull() && eachHandler->IsShared(shared)) {
                 _currentHandler = eachHandler;
                 return;
             }
         }
 
-        _bodyHandlers.emplace_back(new BodyHandler{ _packCount, _typeInfo.GetTypes() });
+        _bodyHandlers.emplace_back(new BodyHandler{ _packCount, _typeInfo, shared });
         _currentHandler = _bodyHandlers.back();
     }
 
     //=================================================================================================================
-    // Entity
+    // Engine
     //=================================================================================================================
-    Entity::Entity(const BodyHandler& handler, EntityPoolIndex poolIndex) : _handler(handler), _poolIndex(poolIndex), _index(handler.Allocate()) {
+    void Engine::RegistryTypeInformation(HashSizePairs&& types, HeaderDesc&& header) {
+        Hashes hashes;
+        for (const auto* eachTypes : { &types, &header.shared, &header.chunk }) {
+            std::ranges::copy(std::views::keys(*eachTypes), std::back_inserter(hashes));
+        }
+
+        for (auto& instance : _instances) {
+            if (instance.IsType(hashes) && instance.GetTypeInfo().GetNumSignature() == hashes.size()) {
+                return;
+            }
+        }
+
+        _instances.emplace_back(TypeInfo{ types, header });
     }
 
-    Entity::~Entity() {
-        _handler.Free(_index);
+    std::unique_ptr<Engine> Engine::Fork() const {
+        auto result = std::make_unique<Engine>();
+
+        // Rows keep their index, only the handler of each location is swapped, chunk by chunk.
+        result->_locations = _locations;
+        for (const auto& instance : _instances) {
+            for (const auto* forked : result->_instances.emplace_back(instance.Fork()).GetHandlers()) {
+                for (const auto entity : forked->GetEntities()) {
+                    result->_locations[entity.index].handler = forked;
+                }
+            }
+        }
+
+        for (const auto& [hash, pool] : _sparsePools) {
+            result->_sparsePools.try_emplace(hash, pool->Clone());
+        }
+        for (const auto& [hash, pool] : _relationPools) {
+            result->_relationPools.try_emplace(hash, std::make_unique<RelationPool>(*pool));
+        }
+
+        result->_reserveIndices = _reserveIndices;
+        result->_destroyQueue = _destroyQueue;
+        result->_numEntities = _numEntities;
+        result->_changeVersion = _changeVersion;
+        return result;
     }
 
-    BodyRef Entity::Get(const Hash hash) const {
-        return _handler.Get(_index, hash);
+    ConstInstanceRefs Engine::CollectInstances(const Hashes& hashes) const {
+        ConstInstanceRefs result;
+        for (const auto& instance : _instances) {
+            if (instance.IsType(hashes)) {
+                result.emplace_back(&instance);
+            }
+        }
+        return result;
     }
 
-    BodyRefs Entity::Get(const Hashes& hashes) const {
-        return _handler.Get(_index, hashes);
+    ConstInstanceRefs Engine::CollectInstances(const QueryDesc& desc) const {
+        ConstInstanceRefs result;
+        for (const auto& instance : _instances) {
+            if (instance.IsMatch(desc)) {
+                result.emplace_back(&instance);
+            }
+        }
+        return result;
     }
 
-    void Entity::ChangeIndex(BodyIndex index) {
-        _index = index;
+    void Engine::ClearCollector(const Collector& collector) {
+        if (nullptr == collector.handler) {
+            return;
+        }
+
+        for (const auto entity : collector.handler->GetEntities()) {
+            ReleaseEntity(entity);
+            --_numEntities;
+        }
+        collector.handler->Clear();
     }
 
-    //=================================================================================================================
-    // EntityPool
-    //=================================================================================================================
-    EntityPool::EntityPool(const BodyHandler& handler) : _handler(handler) {
-        ReservePool(static_cast<EntityPoolIndex>(handler.GetPackCount()));
+    Entity Engine::CreateEntity(const Hashes& hashes, const SharedValues& shared) {
+        auto* instance = FindInstance(hashes);
+        if (nullptr == instance) {
+            return InvalidEntity;
+        }
+
+        const auto* handler = instance->AcquireHandler(MakeSharedKey(instance->GetTypeInfo(), {}, shared));
+        handler->MarkChanged(GetStructuralVersion());
+
+        ++_numEntities;
+        return AllocateEntity(*handler);
     }
 
-    Entity* EntityPool::Allocate() {
-        assert(false == _reserveIndices.empty());
+    std::optional<Prefab> Engine::CreatePrefab(const Hashes& hashes) const {
+        const auto index = FindInstanceIndex(hashes);
+        if (InvalidInstanceIndex == index) {
+            return std::nullopt;
+        }
 
-        const auto index = _reserveIndices.front();
-        _reserveIndices.pop_front();
+        return Prefab{ index, _instances[index].GetTypeInfo() };
+    }
 
-        auto* entity = new(&_buffer[index * sizeof(Entity)]) Entity(_handler, index);
+    std::optional<Prefab> Engine::CreatePrefab(Entity entity) const {
+        const auto* location = GetLocation(entity);
+        if (nullptr == location) {
+            return std::nullopt;
+        }
 
-        const auto lastIndex = 0 == _handler.GetAllocCount() ? 0 : _handler.GetAllocCount() - 1;
-        _entities[lastIndex] = entity;
-        return entity;
+        const auto index = FindInstanceIndex(*location->handler);
+        if (InvalidInstanceIndex == index) {
+            return std::nullopt;
+        }
+
+        Prefab result{ index, _instances[index].GetTypeInfo() };
+        location->handler->CopyRow(location->index, result.GetRow());
+        result.SetSharedKey(location->handler->GetSharedKey());
+        return result;
     }
 
-    void EntityPool::Deallocate(gsl::not_null<Entity*> entity) {
-        const auto index = entity->GetIndex();
-        const auto poolIndex = entity->GetPoolIndex();
-        _reserveIndices.emplace_back(poolIndex);
+    EntityRuns Engine::Instantiate(const Prefab& prefab, size_t count) {
+        if (prefab.GetInstanceIndex() >= _instances.size()) {
+            return {};
+        }
+
+        auto& instance = _instances[prefab.GetInstanceIndex()];
+
+        EntityRuns result;
+        for (size_t created = 0; created < count;) {
+            const auto allocated = AllocateEntities(instance, count - created, prefab.GetSharedKey());
+            const auto& entities = result.emplace_back(allocated.begin(), allocated.end());
+            const auto* location = GetLocation(entities.front());
+            location->handler->Replicate(location->index, static_cast<Size>(entities.size()), prefab.GetRow());
 
-        entity->~Entity();
-        _entities[index] = nullptr;
+            created += entities.size();
+        }
+        return result;
+    }
 
-        auto* lastEntity = _entities[_handler.GetAllocCount()];
-        if(nullptr == lastEntity) {
+    void Engine::DestroyEntity(Entity entity) {
+        if (false == IsAlive(entity)) {
             return;
         }
 
-        lastEntity->ChangeIndex(index);
-        _entities[index] = lastEntity;
-        _entities[_handler.GetAllocCount()] = nullptr;
+        // Cascading sources are queued rather than recursed into, so a deep hierarchy doesn't grow the stack.
+        _destroyQueue.emplace_back(entity);
+        while (false == _destroyQueue.empty()) {
+            const auto each = _destroyQueue.back();
+            _destroyQueue.pop_back();
+            if (false == IsAlive(each)) {
+                continue;
+            }
+
+            for (const auto& pool : std::views::values(_relationPools)) {
+                if (pool->IsCascade()) {
+                    const auto sources = pool->GetSources(each);
+                    _destroyQueue.insert(_destroyQueue.end(), sources.begin(), sources.end());
+                }
+            }
+
+            const auto& location = _locations[each.index];
+            FreeBody(*location.handler, location.index);
+            ReleaseEntity(each);
+            --_numEntities;
+        }
     }
 
-    void EntityPool::Deallocate(BodyIndex bodyIndex) {
-        if(_entities.size() > bodyIndex && _entities[bodyIndex]) {
-            Deallocate(_entities[bodyIndex]);
+    void Engine::DestroyEntity(gsl::not_null<const BodyHandler*>&& handler, BodyIndex index) {
+        if (index >= handler->GetAllocCount()) {
+            return;
         }
+
+        DestroyEntity(handler->GetEntities()[index]);
     }
 
-    void EntityPool::ReservePool(EntityPoolIndex count) {
-        assert(_buffer.empty());
-        _buffer.resize(count * sizeof(Entity));
+    bool Engine::IsAlive(Entity entity) const noexcept {
+        return nullptr != GetLocation(entity);
+    }
 
-        for (decltype(count) i = 0; i < count; ++i) {
-            _reserveIndices.emplace_back(i);
+    const EntityLocation* Engine::GetLocation(Entity entity) const noexcept {
+        if (entity.index >= _locations.size()) {
+            return nullptr;
         }
 
-        _entities.resize(_handler.GetPackCount());
+        const auto& location = _locations[entity.index];
+        if (nullptr == location.handler || location.version != entity.version) {
+            return nullptr;
+        }
+        return &location;
     }
 
-    void EntityPool::Clear() {
-        _handler.Clear();
-
-        _reserveIndices.clear();
-        const auto count = static_cast<EntityPoolIndex>(_buffer.size() / sizeof(Entity));
-        for(std::remove_const_t<decltype(count)> i = 0; i < count; ++i) {
-            _reserveIndices.emplace_back(i);
+    BodyRef Engine::Get(Entity entity, Hash hash) const {
+        const auto* location = GetLocation(entity);
+        if (nullptr == location) {
+            return nullptr;
         }
-        _entities.resize(_handler.GetPackCount(), nullptr);
+
+        return location->handler->Get(location->index, hash);
     }
 
-    //=================================================================================================================
-    // Engine
-    //=================================================================================================================
-    void Engine::RegistryTypeInformation(HashSizePairs&& types) {
-        const auto hashes = std::views::keys(types);
-        for (auto& instance : _instances) {
-            if (instance.IsType(hashes)) {
-                return;
-            }
+    BodyRefs Engine::Get(Entity entity, const Hashes& hashes) const {
+        const auto* location = GetLocation(entity);
+        if (nullptr == location) {
+            return {};
         }
 
-        _instances.emplace_back(TypeInfo{ types });
+        return location->handler->Get(location->index, hashes);
     }
 
-    ConstInstanceRefs Engine::CollectInstances(const Hashes& hashes) const {
-        ConstInstanceRefs result;
-        for (const auto& instance : _instances) {
-            if (instance.IsType(hashes)) {
-                result.emplace_back(&instance);
-            }
+    bool Engine::IsEnabled(Entity entity, Hash hash) const noexcept {
+        const auto* location = GetLocation(entity);
+        return nullptr != location && location->handler->IsEnabled(location->index, hash);
+    }
+
+    void Engine::SetEnabled(Entity entity, Hash hash, bool isEnabled) {
+        const auto* location = GetLocation(entity);
+        if (nullptr == location || isEnabled == location->handler->IsEnabled(location->index, hash)) {
+            return;
         }
-        return result;
+
+        location->handler->SetEnabled(location->index, hash, isEnabled);
+        location->handler->MarkChanged(hash, GetStructuralVersion());
+    }
+
+    const uint8_t* Engine::GetShared(Entity entity, Hash hash) const {
+        const auto* location = GetLocation(entity);
+        return nullptr == location ? nullptr : location->handler->FindShared(hash);
+    }
+
+    BodyRef Engine::GetChunkComponent(Entity entity, Hash hash) const {
+        const auto* location = GetLocation(entity);
+        return nullptr == location ? nullptr : location->handler->FindChunkComponent(hash);
     }
 
-    void Engine::ClearCollector(const Collector& collector) const {
-        const auto findIterator = _entityPool.find(collector.handler);
-        if(_entityPool.end() == findIterator) {
+    void Engine::SetShared(Entity entity, const SharedValue& value) {
+        const auto* location = GetLocation(entity);
+        if (nullptr == location) {
+            return;
+        }
+
+        const auto& source = *location->handler;
+        const auto instanceIndex = FindInstanceIndex(source);
+        if (InvalidInstanceIndex == instanceIndex) {
+            return;
+        }
+
+        auto& instance = _instances[instanceIndex];
+        const auto shared = MakeSharedKey(instance.GetTypeInfo(), source.GetSharedKey(), { value });
+        if (source.IsShared(shared)) {
             return;
         }
 
-        findIterator->second.Clear();
+        // Moves the row into a chunk holding the new value, the same way a structural change would.
+        std::vector<uint8_t> row(instance.GetTypeInfo().GetTotalSize() - EntityColumnSize);
+        source.CopyRow(location->index, row.data());
+
+        const auto* dest = instance.AcquireHandler(shared);
+        const auto destIndex = dest->Allocate(entity);
+        dest->Replicate(destIndex, 1, row.data());
+        source.CopyEnabled(location->index, *dest, destIndex);
+        dest->MarkChanged(GetStructuralVersion());
+
+        FreeBody(source, location->index);
+        _locations[entity.index].handler = dest;
+        _locations[entity.index].index = destIndex;
     }
 
-    Entity* Engine::CreateEntity(const Hashes& hashes) {
-        if(hashes.empty()) {
-            return nullptr;
+    const SparsePool* Engine::FindSparse(Hash hash) const noexcept {
+        const auto findIterator = _sparsePools.find(hash);
+        return _sparsePools.end() == findIterator ? nullptr : findIterator->second.get();
+    }
+
+    const RelationPool* Engine::FindRelation(Hash hash) const noexcept {
+        const auto findIterator = _relationPools.find(hash);
+        return _relationPools.end() == findIterator ? nullptr : findIterator->second.get();
+    }
+
+    std::vector<uint8_t> Engine::MakeSharedKey(const TypeInfo& typeInfo, SharedKey base, const SharedValues& values) {
+        std::vector<uint8_t> result(typeInfo.GetSharedSize(), 0);
+        std::ranges::copy(base.first(std::min(base.size(), result.size())), result.begin());
+
+        for (const auto& [hash, bytes] : values) {
+            const auto findIterator = std::ranges::find(typeInfo.GetHeaderTypes(), hash, &Type::hash);
+            if (typeInfo.GetHeaderTypes().end() == findIterator || findIterator->offset >= typeInfo.GetSharedSize() || bytes.size() != findIterator->size) {
+                continue;
+            }
+            std::ranges::copy(bytes, result.begin() + findIterator->offset);
         }
+        return result;
+    }
 
-        for (auto& instance : _instances) {
-            if (const auto* handler = instance.FindHandler(hashes);
-                nullptr != handler) {
-                ++_numEntities;
-
-                if(const auto findIterator = _entityPool.find(handler);
-                    _entityPool.end() == findIterator) {
-                    if(const auto&[resultPair, isSuccess] = _entityPool.try_emplace(handler, *handler); 
-                        isSuccess) {
-                        return resultPair->second.Allocate();
-                    }
-                }
-                else {
-                    return findIterator->second.Allocate();
-                }
-                break;
+    size_t Engine::FindInstanceIndex(const Hashes& hashes) const {
+        if (hashes.empty()) {
+            return InvalidInstanceIndex;
+        }
+
+        // An exact signature wins over a superset, so creating untagged entities doesn't land in a tagged archetype.
+        auto result = InvalidInstanceIndex;
+        for (size_t i = 0; i < _instances.size(); ++i) {
+            const auto& instance = _instances[i];
+            if (false == instance.IsType(hashes)) {
+                continue;
+            }
+
+            if (instance.GetTypeInfo().GetNumSignature() == hashes.size()) {
+                return i;
+            }
+            if (InvalidInstanceIndex == result) {
+                result = i;
             }
         }
+        return result;
+    }
 
-        return nullptr;
+    size_t Engine::FindInstanceIndex(const BodyHandler& handler) const {
+        const auto findIterator = std::ranges::find_if(_instances, [&handler](const auto& instance)->bool {
+            return std::ranges::find(instance.GetHandlers(), &handler) != instance.GetHandlers().end();
+        });
+        return _instances.end() == findIterator ? InvalidInstanceIndex : static_cast<size_t>(std::distance(_instances.begin(), findIterator));
     }
 
-    void Engine::DestroyEntity(gsl::not_null<Entity*>&& entity) {
-        DestroyEntity(&entity->_handler, entity->_index);
+    Instance* Engine::FindInstance(const Hashes& hashes) {
+        const auto index = FindInstanceIndex(hashes);
+        return InvalidInstanceIndex == index ? nullptr : &_instances[index];
     }
 
-    void Engine::DestroyEntity(gsl::not_null<const BodyHandler*>&& handler, BodyIndex index) {
-        --_numEntities;
+    std::span<const Entity> Engine::AllocateEntities(Instance& instance, size_t count, SharedKey shared) {
+        const auto* handler = instance.AcquireHandler(shared);
+        const auto start = handler->GetAllocCount();
+        const auto num = static_cast<Size>(std::min<size_t>(count, handler->GetPackCount() - start));
 
-        const auto findIterator = _entityPool.find(handler.get());
-        if (_entityPool.end() == findIterator) {
-            return;
+        for (Size i = 0; i < num; ++i) {
+            AllocateEntity(*handler);
         }
+        handler->MarkChanged(GetStructuralVersion());
+        _numEntities += num;
 
-        findIterator->second.Deallocate(index);
+        return handler->GetEntities().subspan(start, num);
     }
 
-    Entities Engine::CollectEntities(const Collector& collector) const {
-        const auto findIterator = _entityPool.find(collector.handler);
-        if (_entityPool.end() == findIterator) {
-            return {};
+    Entity Engine::AllocateEntity(const BodyHandler& handler) {
+        EntityIndex index = 0;
+        if (_reserveIndices.empty()) {
+            index = static_cast<EntityIndex>(_locations.size());
+            _locations.emplace_back();
+        }
+        else {
+            index = _reserveIndices.front();
+            _reserveIndices.pop_front();
         }
 
-        return findIterator->second.GetEntities();
+        auto& location = _locations[index];
+        const Entity entity{ index, location.version };
+        location.handler = &handler;
+        location.index = handler.Allocate(entity);
+        return entity;
+    }
+
+    void Engine::ReleaseEntity(Entity entity) {
+        for (const auto& pool : std::views::values(_sparsePools)) {
+            pool->Remove(entity);
+        }
+        for (const auto& pool : std::views::values(_relationPools)) {
+            pool->Detach(entity);
+        }
+
+        auto& location = _locations[entity.index];
+        location.handler = nullptr;
+        location.index = InvalidBodyIndex;
+        ++location.version;
+        _reserveIndices.emplace_back(entity.index);
+    }
+
+    void Engine::FreeBody(const BodyHandler& handler, BodyIndex index) {
+        if (const auto moved = handler.Free(index);
+            InvalidEntity != moved) {
+            _locations[moved.index].index = index;
+        }
+        // Removing the last row moves nothing, it still changes what the chunk holds.
+        handler.MarkChanged(GetStructuralVersion());
     }
 }
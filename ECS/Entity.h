@@ -3,14 +3,32 @@
 #pragma once
 
 #include <ECS/chunk.h>
+#include <ECS/prefab.h>
+#include <ECS/sparseset.h>
+#include <ECS/relation.h>
 
 namespace ECS {
     using namespace Chunk;
 
     struct Collector {
-        const BodyHandler* handler = nullptr;
-        const Size         count   = 0;
-        BodyRefs           refs;
+        const BodyHandler*      handler = nullptr;
+        const Size              count   = 0;
+        std::span<const Entity> entities;
+        BodyRefs                refs;
+    };
+
+    //=================================================================================================================
+    // QueryDesc
+    // Archetype level matching : every hash of all, none of none, at least one of any (when not empty), and every
+    // hash of columns as a per entity column, so a shared or chunk component never stands in for a query column.
+    // Optional hashes don't take part in matching, their refs are nullptr in chunks that lack them.
+    //=================================================================================================================
+    struct QueryDesc {
+        Hashes all;
+        Hashes none;
+        Hashes any;
+        Hashes optional;
+        Hashes columns;
     };
 
     using Collectors        = std::vector<Collector>;
@@ -32,15 +50,26 @@ namespace ECS {
 
         [[nodiscard]] bool               IsType(const HashSizePairsKeys& hashes) const;
         [[nodiscard]] bool               IsType(const Hashes& hashes) const;
+        [[nodiscard]] bool               IsHas(Hash hash) const;
+        [[nodiscard]] bool               IsMatch(const QueryDesc& desc) const;
 
-        [[nodiscard]] Collectors         GenerateCollector(const Hashes& hashes) const;
+        // One collector per run of rows enabled for every hash of required, refs pointing at the run's first row.
+        [[nodiscard]] Collectors         GenerateCollector(const Hashes& hashes, const Hashes& required = {}) const;
+        // Same chunks in the same order, each forked from this instance's.
+        [[nodiscard]] Instance           Fork() const;
 
         [[nodiscard]] const BodyHandler* FindHandler(const Hashes& hashes);
+        // Current chunk when it has room and holds the shared values, else the first such chunk or a new one.
+        [[nodiscard]] const BodyHandler* AcquireHandler(SharedKey shared = {});
+        [[nodiscard]] constexpr const BodyHandlerOwners& GetHandlers() const noexcept { return _bodyHandlers; }
+        [[nodiscard]] constexpr const TypeInfo&          GetTypeInfo() const noexcept { return _typeInfo; }
 
         void                             RemoveEmptyHandler();
 
     private:
-        void                             RefreshCurrentHandler();
+        Instance(const TypeInfo& typeInfo, BodyHandlerOwners&& handlers, const BodyHandler* currentHandler);
+
+        void                             RefreshCurrentHandler(SharedKey shared);
 
         const TypeInfo                   _typeInfo;
         const Size                       _packCount = 0;
@@ -49,108 +78,207 @@ namespace ECS {
     };
 
     //=================================================================================================================
-    // Entity
+    // Engine
     //=================================================================================================================
-    using EntityPoolIndex = uint16_t;
-
-    class Entity {
-    private:
-        friend class Engine;
-        friend class EntityPool;
+    struct EntityLocation {
+        const BodyHandler* handler = nullptr;
+        BodyIndex          index   = InvalidBodyIndex;
+        EntityVersion      version = 0;
+    };
 
-        explicit Entity(const BodyHandler& handler, EntityPoolIndex poolIndex);
-        ~Entity();
+    using Instances               = std::vector<Instance>;
+    using ConstInstanceRefs       = std::vector<const Instance*>;
+    using EntityLocations         = std::vector<EntityLocation>;
+    using EntityIndices           = std::deque<EntityIndex>;
+    // Entities made by one call, a run per chunk they landed in. Copied out of the chunks, which move rows and copy
+    // their bodies on write after a Fork.
+    using EntityRuns              = std::vector<std::vector<Entity>>;
+    using SparsePools             = std::unordered_map<Hash, std::unique_ptr<SparsePool>>;
+    using RelationPools           = std::unordered_map<Hash, std::unique_ptr<RelationPool>>;
+    constexpr size_t InvalidInstanceIndex = std::numeric_limits<size_t>::max();
 
+    class Engine {
     public:
-        Entity(const Entity&)            = delete;
-        Entity(Entity&&)                 = delete;
-        Entity& operator=(const Entity&) = delete;
-        Entity& operator=(Entity&&)      = delete;
+        Engine()                         = default;
+        ~Engine()                        = default;
+        Engine(const Engine&)            = delete;
+        Engine(Engine&&)                 = delete;
+        Engine& operator=(const Engine&) = delete;
+        Engine& operator=(Engine&&)      = delete;
 
-        [[nodiscard]] BodyRef  Get(const Hash hash) const;
-        [[nodiscard]] BodyRefs Get(const Hashes& hashes) const;
+        void                                RegistryTypeInformation(HashSizePairs&& types, HeaderDesc&& header = {});
 
-        [[nodiscard]] EntityPoolIndex GetPoolIndex() const noexcept {
-            return _poolIndex;
-        }
+        // Child world for speculative runs. Chunks are shared copy on write, so forking costs a handler per chunk
+        // and the entity table, and a chunk is only duplicated when either world writes it; sparse sets and
+        // relations are copied. The two are independent afterwards and may run on different threads. A write to a
+        // shared chunk moves its rows to a new body, so spans into chunks, e.g. GetEntities(), end at the next write.
+        [[nodiscard]] std::unique_ptr<Engine> Fork() const;
 
-        [[nodiscard]] BodyIndex GetIndex() const noexcept {
-            return _index;
-        }
+        [[nodiscard]] ConstInstanceRefs     CollectInstances(const Hashes& hashes) const;
+        [[nodiscard]] ConstInstanceRefs     CollectInstances(const QueryDesc& desc) const;
+        // Destroys every row of the collector's chunk, not only the run it covers.
+        void                                ClearCollector(const Collector& collector);
 
-        template<typename T>
-        [[nodiscard]] T* Accept(const Hash hash) const {
-            return reinterpret_cast<T*>(Get(hash));
-        }
+        Entity                              CreateEntity(const Hashes& hashes, const SharedValues& shared = {});
+        template<typename... Ts, typename... Initializers>
+        EntityRuns                          CreateEntities(size_t count, Initializers&&... initializers);
 
-    private:
-        void                         ChangeIndex(BodyIndex index);
+        [[nodiscard]] std::optional<Prefab> CreatePrefab(const Hashes& hashes) const;
+        [[nodiscard]] std::optional<Prefab> CreatePrefab(Entity entity) const;
+        EntityRuns                          Instantiate(const Prefab& prefab, size_t count);
+        template<typename... Ts, typename Func>
+        EntityRuns                          Instantiate(const Prefab& prefab, size_t count, Func&& func);
+        void                                DestroyEntity(Entity entity);
+        void                                DestroyEntity(gsl::not_null<const BodyHandler*>&& handler, BodyIndex index);
 
-        const BodyHandler&           _handler;
-        const EntityPoolIndex        _poolIndex;
-        BodyIndex                    _index = InvalidBodyIndex;
-    };
+        [[nodiscard]] bool                  IsAlive(Entity entity) const noexcept;
+        [[nodiscard]] const EntityLocation* GetLocation(Entity entity) const noexcept;
 
-    //=================================================================================================================
-    // EntityPool
-    //=================================================================================================================
-    using Entities = std::vector<Entity*>;
+        [[nodiscard]] BodyRef               Get(Entity entity, Hash hash) const;
+        [[nodiscard]] BodyRefs              Get(Entity entity, const Hashes& hashes) const;
 
-    class EntityPool {
-        friend class Engine;
+        // Per entity toggle without a row move. Queries and Systems skip entities with any of their required hashes
+        // disabled.
+        [[nodiscard]] bool                  IsEnabled(Entity entity, Hash hash) const noexcept;
+        void                                SetEnabled(Entity entity, Hash hash, bool isEnabled);
 
-    public:
-        explicit EntityPool(const BodyHandler& handler);
+        // Shared values are stored once per chunk, changing one moves the entity to a chunk holding the new value.
+        [[nodiscard]] const uint8_t*        GetShared(Entity entity, Hash hash) const;
+        void                                SetShared(Entity entity, const SharedValue& value);
+        [[nodiscard]] BodyRef               GetChunkComponent(Entity entity, Hash hash) const;
 
-        [[nodiscard]] const Entities& GetEntities() const noexcept {
-            return _entities;
+        // Created on first use, destroyed entities are dropped from every pool.
+        template<typename T>
+        [[nodiscard]] SparseSet<T>&         GetSparse();
+        [[nodiscard]] const SparsePool*     FindSparse(Hash hash) const noexcept;
+
+        // Destroying an entity detaches it from every relation; DestroyEntity also destroys the sources of
+        // cascade relations, ClearCollector only detaches them.
+        template<typename R>
+        [[nodiscard]] RelationPool&         GetRelation();
+        [[nodiscard]] const RelationPool*   FindRelation(Hash hash) const noexcept;
+        template<typename R>
+        void                                SetRelation(Entity source, Entity target);
+
+        [[nodiscard]] constexpr size_t      GetNumTotalEntity() const noexcept { return _numEntities; }
+        [[nodiscard]] constexpr size_t      GetNumInstance() const noexcept { return _instances.size(); }
+        // Upper bound of Entity::index, for side tables indexed by entity.
+        [[nodiscard]] constexpr size_t      GetEntityCapacity() const noexcept { return _locations.size(); }
+
+        [[nodiscard]] constexpr ChangeVersion GetChangeVersion() const noexcept { return _changeVersion; }
+        ChangeVersion                       IncrementChangeVersion() noexcept { return ++_changeVersion; }
+        // Newer than every version a query has already run at, so changes stamped with it are seen by all of them.
+        [[nodiscard]] constexpr ChangeVersion GetStructuralVersion() const noexcept { return _changeVersion + 1; }
+
+        template<typename T>
+        [[nodiscard]] T* Accept(Entity entity, const Hash hash) const {
+            return reinterpret_cast<T*>(Get(entity, hash));
         }
 
-        Entity*                     Allocate();
-        void                        Deallocate(gsl::not_null<Entity*> entity);
-        void                        Deallocate(BodyIndex index);
+        template<typename... Ts, typename Func>
+        void                                Each(Func&& func);
 
     private:
-        void                        ReservePool(EntityPoolIndex count);
-        void                        Clear();
+        template<typename T, typename Initializer>
+        static void                         InitializeColumn(T* column, BodyIndex start, size_t count, size_t first, Initializer& initializer);
+        template<typename... Ts, typename... Initializers, size_t... Indices>
+        static void                         InitializeColumns(const BodyHandler& handler, const Hashes& hashes, BodyIndex start, size_t count, size_t first,
+                                                              std::index_sequence<Indices...>, Initializers&... initializers);
+
+        [[nodiscard]] size_t                FindInstanceIndex(const Hashes& hashes) const;
+        [[nodiscard]] size_t                FindInstanceIndex(const BodyHandler& handler) const;
+        [[nodiscard]] Instance*             FindInstance(const Hashes& hashes);
+        std::span<const Entity>             AllocateEntities(Instance& instance, size_t count, SharedKey shared = {});
+        Entity                              AllocateEntity(const BodyHandler& handler);
+        void                                ReleaseEntity(Entity entity);
+        void                                FreeBody(const BodyHandler& handler, BodyIndex index);
+        [[nodiscard]] static std::vector<uint8_t> MakeSharedKey(const TypeInfo& typeInfo, SharedKey base, const SharedValues& values);
+
+
+        Instances                           _instances;
+        EntityLocations                     _locations;
+        EntityIndices                       _reserveIndices;
+        SparsePools                         _sparsePools;
+        RelationPools                       _relationPools;
+        Entities                            _destroyQueue;
+        size_t                              _numEntities = 0;
+        ChangeVersion                       _changeVersion = 0;
+    };
 
-        const BodyHandler&          _handler;
+    template<typename T>
+    SparseSet<T>& Engine::GetSparse() {
+        auto& pool = _sparsePools[TypeHash<T>()];
+        if (nullptr == pool) {
+            pool = std::make_unique<SparseSet<T>>();
+        }
+        return static_cast<SparseSet<T>&>(*pool);
+    }
+
+    template<typename R>
+    RelationPool& Engine::GetRelation() {
+        auto& pool = _relationPools[TypeHash<R>()];
+        if (nullptr == pool) {
+            pool = std::make_unique<RelationPool>(IsCascadeRelation<R>());
+        }
+        return *pool;
+    }
 
-        std::vector<char>           _buffer;
-        std::deque<EntityPoolIndex> _reserveIndices;
-        Entities                    _entities;
-    };
+    template<typename R>
+    void Engine::SetRelation(Entity source, Entity target) {
+        if (source == target || false == IsAlive(source) || false == IsAlive(target)) {
+            return;
+        }
+        GetRelation<R>().Set(source, target);
+    }
+
+    // Initializer per component : a value copied into every new row, or a generator called as T(size_t index).
+    // Components of the archetype not listed in Ts are left as the slot held them, the same as CreateEntity.
+    template<typename... Ts, typename... Initializers>
+    EntityRuns Engine::CreateEntities(size_t count, Initializers&&... initializers) {
+        static_assert(sizeof...(Ts) == sizeof...(Initializers), "One initializer per component.");
+        static_assert(((false == std::is_empty_v<Ts>) && ...), "Tags have no column to initialize.");
+
+        static const Hashes hashes{ TypeHash<Ts>()... };
+        auto* instance = FindInstance(hashes);
+        if (nullptr == instance) {
+            return {};
+        }
 
-    //=================================================================================================================
-    // Engine
-    //=================================================================================================================
-    using Instances               = std::vector<Instance>;
-    using ConstInstanceRefs       = std::vector<const Instance*>;
-    using BodyHandlerAtEntityPool = std::unordered_map<const BodyHandler*, EntityPool>;
+        EntityRuns result;
+        for (size_t created = 0; created < count;) {
+            const auto allocated = AllocateEntities(*instance, count - created);
+            const auto& entities = result.emplace_back(allocated.begin(), allocated.end());
+            const auto* location = GetLocation(entities.front());
 
-    class Engine {
-    public:
-        Engine()                         = default;
-        ~Engine()                        = default;
-        Engine(const Engine&)            = delete;
-        Engine(Engine&&)                 = delete;
-        Engine& operator=(const Engine&) = delete;
-        Engine& operator=(Engine&&)      = delete;
+            InitializeColumns<Ts...>(*location->handler, hashes, location->index, entities.size(), created, std::index_sequence_for<Ts...>{}, initializers...);
 
-        void                               RegistryTypeInformation(HashSizePairs&& types);
-        [[nodiscard]] ConstInstanceRefs    CollectInstances(const Hashes& hashes) const;
-        void                               ClearCollector(const Collector& collector) const;
+            created += entities.size();
+        }
+        return result;
+    }
 
-        Entity*                            CreateEntity(const Hashes& hashes);
-        void                               DestroyEntity(gsl::not_null<Entity*>&& entity);
-        void                               DestroyEntity(gsl::not_null<const BodyHandler*>&& handler, BodyIndex index);
+    template<typename T, typename Initializer>
+    void Engine::InitializeColumn(T* column, BodyIndex start, size_t count, size_t first, Initializer& initializer) {
+        static_assert(std::is_trivially_copyable_v<T>, "Chunk components must be trivially copyable.");
 
-        [[nodiscard]] Entities             CollectEntities(const Collector& collector) const;
-        [[nodiscard]] constexpr size_t     GetNumTotalEntity() const noexcept { return _numEntities; }
+        if (nullptr == column) {
+            return;
+        }
+        column += start;
 
-    private:
-        Instances                          _instances;
-        mutable BodyHandlerAtEntityPool    _entityPool;
-        size_t                             _numEntities = 0;
-    };
+        if constexpr (std::is_invocable_r_v<T, Initializer&, size_t>) {
+            for (size_t i = 0; i < count; ++i) {
+                column[i] = initializer(first + i);
+            }
+        }
+        else {
+            std::fill_n(column, count, static_cast<const T&>(initializer));
+        }
+    }
+
+    template<typename... Ts, typename... Initializers, size_t... Indices>
+    void Engine::InitializeColumns(const BodyHandler& handler, const Hashes& hashes, BodyIndex start, size_t count, size_t first,
+                                   std::index_sequence<Indices...>, Initializers&... initializers) {
+        (InitializeColumn(reinterpret_cast<Ts*>(handler.Find(hashes[Indices])), start, count, first, initializers), ...);
+    }
 }
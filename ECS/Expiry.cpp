@@ -0,0 +1,115 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#include <pch.h>
+#include "expiry.h"
+
+namespace ECS {
+    Expiry::Expiry(float tickSeconds) : _tickSeconds(tickSeconds) {
+    }
+
+    void Expiry::Schedule(Entity entity, float deathTime) {
+        if (entity.index >= _deadlines.size()) {
+            _deadlines.resize(static_cast<size_t>(entity.index) + 1);
+        }
+
+        auto& latest = _deadlines[entity.index];
+        if (InvalidEntity == latest.entity) {
+            ++_numScheduled;
+        }
+
+        latest = { entity, std::max(ToTick(deathTime), _current + 1) };
+        Insert(latest);
+    }
+
+    void Expiry::Cancel(Entity entity) noexcept {
+        if (entity.index >= _deadlines.size() || entity != _deadlines[entity.index].entity) {
+            return;
+        }
+
+        _deadlines[entity.index] = {};
+        --_numScheduled;
+    }
+
+    size_t Expiry::Update(Engine& engine, float now) {
+        // Deadlines round up and now rounds down, so nothing goes before its time.
+        const auto target = 0.0f >= now ? 0 : static_cast<Tick>(std::floor(now / _tickSeconds));
+        if (0 == _numScheduled) {
+            _current = std::max(_current, target);
+            return 0;
+        }
+
+        _expired.clear();
+        while (_current < target) {
+            ++_current;
+
+            // Wrapping levels hand their next slot down before the first level is read.
+            for (size_t level = 1; level < NumLevels && 0 == (_current & ((Tick{ 1 } << (SlotBits * level)) - 1)); ++level) {
+                Cascade(level);
+            }
+
+            auto& slot = _levels[0][_current & (NumSlots - 1)];
+            for (const auto& deadline : slot) {
+                if (IsCurrent(deadline)) {
+                    _expired.emplace_back(deadline.entity);
+                    _deadlines[deadline.entity.index] = {};
+                    --_numScheduled;
+                }
+            }
+            slot.clear();
+        }
+
+        // Grouped by chunk, back to front, so each chunk is touched once and swapped rows are already handled.
+        const auto toKey = [&engine](Entity entity) {
+            const auto* location = engine.GetLocation(entity);
+            return nullptr == location ? std::pair<const BodyHandler*, BodyIndex>{ nullptr, 0 } : std::pair{ location->handler, location->index };
+        };
+        std::ranges::sort(_expired, [&toKey](const auto lhs, const auto rhs)->bool {
+            const auto [lhsHandler, lhsIndex] = toKey(lhs);
+            const auto [rhsHandler, rhsIndex] = toKey(rhs);
+            return lhsHandler != rhsHandler ? std::less<>{}(lhsHandler, rhsHandler) : lhsIndex > rhsIndex;
+        });
+
+        size_t result = 0;
+        for (const auto entity : _expired) {
+            if (engine.IsAlive(entity)) {
+                engine.DestroyEntity(entity);
+                ++result;
+            }
+        }
+        return result;
+    }
+
+    Expiry::Tick Expiry::ToTick(float time) const noexcept {
+        return 0.0f >= time ? 0 : static_cast<Tick>(std::ceil(time / _tickSeconds));
+    }
+
+    void Expiry::Insert(const Deadline& deadline) {
+        const auto distance = deadline.tick - _current;
+
+        size_t level = 0;
+        while (level + 1 < NumLevels && distance >= (Tick{ 1 } << (SlotBits * (level + 1)))) {
+            ++level;
+        }
+
+        // Past the last level, park it in the farthest slot and let cascades bring it back.
+        const auto tick = std::min(deadline.tick, _current + (Tick{ 1 } << (SlotBits * NumLevels)) - 1);
+        _levels[level][(tick >> (SlotBits * level)) & (NumSlots - 1)].emplace_back(deadline);
+    }
+
+    void Expiry::Cascade(size_t level) {
+        auto& slot = _levels[level][(_current >> (SlotBits * level)) & (NumSlots - 1)];
+        Slot moved;
+        moved.swap(slot);
+
+        for (const auto& deadline : moved) {
+            if (IsCurrent(deadline)) {
+                Insert(deadline);
+            }
+        }
+    }
+
+    bool Expiry::IsCurrent(const Deadline& deadline) const noexcept {
+        const auto& latest = _deadlines[deadline.entity.index];
+        return latest.entity == deadline.entity && latest.tick == deadline.tick;
+    }
+}
@@ -0,0 +1,55 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/entity.h>
+
+namespace ECS {
+    //=================================================================================================================
+    // Expiry
+    // Destroys entities at an absolute time. Deadlines sit in a hierarchical timer wheel : the first level holds
+    // one slot per tick, every next level one slot per full turn of the level below, and a slot is redistributed
+    // downwards when the level below wraps. Update is the sync point, costing O(expired + ticks) rather than
+    // O(alive); the expired batch is destroyed grouped by chunk.
+    //=================================================================================================================
+    class Expiry {
+    public:
+        explicit Expiry(float tickSeconds = 1.0f / 60.0f);
+
+        // A later call for the same entity replaces its deadline.
+        void                          Schedule(Entity entity, float deathTime);
+        void                          Cancel(Entity entity) noexcept;
+
+        // Destroys every scheduled entity whose deadline is at or before now, returns how many were destroyed.
+        size_t                        Update(Engine& engine, float now);
+
+        [[nodiscard]] constexpr size_t GetNumScheduled() const noexcept { return _numScheduled; }
+
+    private:
+        using Tick                    = uint64_t;
+        static constexpr size_t       SlotBits  = 6;
+        static constexpr size_t       NumSlots  = size_t{ 1 } << SlotBits;
+        static constexpr size_t       NumLevels = 4;
+
+        struct Deadline {
+            Entity                    entity;
+            Tick                      tick = 0;
+        };
+        using Slot                    = std::vector<Deadline>;
+        using Level                   = std::array<Slot, NumSlots>;
+
+        [[nodiscard]] Tick            ToTick(float time) const noexcept;
+        void                          Insert(const Deadline& deadline);
+        void                          Cascade(size_t level);
+        [[nodiscard]] bool            IsCurrent(const Deadline& deadline) const noexcept;
+
+        const float                   _tickSeconds;
+        Tick                          _current = 0;
+        std::array<Level, NumLevels>  _levels;
+
+        // Latest deadline per entity index, so replaced and cancelled entries are dropped when their slot expires.
+        std::vector<Deadline>         _deadlines;
+        size_t                        _numScheduled = 0;
+        Entities                      _expired;
+    };
+}
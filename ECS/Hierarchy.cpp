@@ -0,0 +1,166 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#include <pch.h>
+#include "hierarchy.h"
+
+#include "componentlookup.h"
+
+namespace ECS {
+    HashSizePairs TransformHierarchy::GetHashSizePairs() {
+        return { TypeHashSize<LocalToParent>(), TypeHashSize<LocalToWorld>() };
+    }
+
+    HeaderDesc TransformHierarchy::GetHeaderDesc() {
+        return { .shared = { TypeHashSize<HierarchyDepth>() }, .chunk = {} };
+    }
+
+    Hashes TransformHierarchy::GetHashes() {
+        return { TypeHash<LocalToParent>(), TypeHash<LocalToWorld>(), TypeHash<HierarchyDepth>() };
+    }
+
+    void TransformHierarchy::SetParent(Engine& engine, Entity child, Entity parent) {
+        auto& relation = engine.GetRelation<ChildOf>();
+        if (InvalidEntity == parent) {
+            relation.Remove(child);
+        }
+        else {
+            for (auto ancestor = parent; InvalidEntity != ancestor; ancestor = relation.GetTarget(ancestor)) {
+                if (child == ancestor) {
+                    return;
+                }
+            }
+
+            engine.SetRelation<ChildOf>(child, parent);
+            if (parent != relation.GetTarget(child)) {
+                return;
+            }
+        }
+
+        // The moved subtree takes its depth from the new parent; a changed depth moves the row to that level's chunks.
+        std::deque<Entity> pending{ child };
+        while (false == pending.empty()) {
+            const auto each = pending.front();
+            pending.pop_front();
+
+            const auto target = relation.GetTarget(each);
+            const auto depth = InvalidEntity == target ? 0 : GetDepth(engine, target) + 1;
+            engine.SetShared(each, MakeSharedValue(HierarchyDepth{ depth }));
+            _maxDepth = std::max(_maxDepth, depth);
+
+            const auto sources = relation.GetSources(each);
+            pending.insert(pending.end(), sources.begin(), sources.end());
+        }
+
+        // Same depth means no row move, so flag the new local space by hand.
+        if (const auto* location = engine.GetLocation(child)) {
+            location->handler->MarkChanged(TypeHash<LocalToParent>(), engine.IncrementChangeVersion());
+        }
+    }
+
+    void TransformHierarchy::Run(Engine& engine, JobSystem& jobs) {
+        BeginRun(engine);
+        for (uint32_t depth = 0; depth <= _maxDepth; ++depth) {
+            jobs.Wait(ScheduleLevel(engine, jobs, depth));
+            EndLevel();
+        }
+        _lastVersion = _runVersion;
+    }
+
+    AsyncTask TransformHierarchy::RunAsync(Engine& engine, JobSystem& jobs) {
+        BeginRun(engine);
+        for (uint32_t depth = 0; depth <= _maxDepth; ++depth) {
+            co_await ScheduleLevel(engine, jobs, depth);
+            EndLevel();
+        }
+        _lastVersion = _runVersion;
+    }
+
+    void TransformHierarchy::BeginRun(Engine& engine) {
+        if (false == _query.has_value() || &_query->GetEngine() != &engine) {
+            _query.emplace(engine).WhereChunk([this](const BodyHandler& handler)->bool {
+                return 0 < _numDirty || handler.GetChangeVersion(TypeHash<LocalToParent>()) > _lastVersion;
+            });
+            _lastVersion = 0;
+        }
+
+        _runVersion = engine.IncrementChangeVersion();
+        _stamps.resize(engine.GetEntityCapacity(), 0);
+        _numDirty = 0;
+        _numUpdated = 0;
+        RefreshMaxDepth();
+    }
+
+    // Destroys and re-parenting may empty the deepest levels, the sweep stops at the deepest chunk holding rows.
+    void TransformHierarchy::RefreshMaxDepth() {
+        _maxDepth = 0;
+        for (const auto* instance : _query->MatchInstances()) {
+            for (const auto* handler : instance->GetHandlers()) {
+                const auto* depth = reinterpret_cast<const HierarchyDepth*>(handler->FindShared(TypeHash<HierarchyDepth>()));
+                if (nullptr != depth && false == handler->IsEmpty()) {
+                    _maxDepth = std::max(_maxDepth, depth->value);
+                }
+            }
+        }
+    }
+
+    JobHandle TransformHierarchy::ScheduleLevel(const Engine& engine, JobSystem& jobs, uint32_t depth) {
+        _tasks.clear();
+        _query->Shared(HierarchyDepth{ depth }).EachChunk([this](const QueryChunk& chunk, std::span<const LocalToParent>, std::span<const LocalToWorld>) {
+            // Spans are taken again after the copy on write, so every one of them points into the body written.
+            const auto* handler = chunk.handler;
+            handler->Detach();
+
+            const auto count = chunk.entities.size();
+            _tasks.emplace_back(handler, handler->GetEntities().subspan(chunk.start, count),
+                                std::span<const LocalToParent>{ reinterpret_cast<const LocalToParent*>(handler->Read(TypeHash<LocalToParent>())) + chunk.start, count },
+                                std::span<LocalToWorld>{ reinterpret_cast<LocalToWorld*>(handler->Find(TypeHash<LocalToWorld>())) + chunk.start, count });
+        });
+
+        _levelDirty = 0;
+        return jobs.Schedule(_tasks.size(), 1, [this, &engine](size_t begin, size_t end) {
+            _levelDirty += RunTasks(engine, begin, end);
+        });
+    }
+
+    void TransformHierarchy::EndLevel() {
+        _numDirty = _levelDirty;
+        _numUpdated += _numDirty;
+
+        for (const auto& task : _tasks) {
+            if (task.isWritten) {
+                task.handler->MarkChanged(TypeHash<LocalToWorld>(), _runVersion);
+            }
+        }
+    }
+
+    uint32_t TransformHierarchy::GetDepth(const Engine& engine, Entity entity) {
+        const auto* depth = reinterpret_cast<const HierarchyDepth*>(engine.GetShared(entity, TypeHash<HierarchyDepth>()));
+        return nullptr == depth ? 0 : depth->value;
+    }
+
+    size_t TransformHierarchy::RunTasks(const Engine& engine, size_t begin, size_t end) {
+        // One lookup per batch, its column cache isn't shared between threads.
+        ComponentLookup<const LocalToWorld> parentWorlds(engine);
+        const auto* relation = engine.FindRelation(TypeHash<ChildOf>());
+
+        size_t result = 0;
+        for (auto i = begin; i < end; ++i) {
+            auto& [handler, entities, locals, worlds, isWritten] = _tasks[i];
+            const auto isChunkDirty = handler->GetChangeVersion(TypeHash<LocalToParent>()) > _lastVersion;
+
+            for (size_t row = 0; row < entities.size(); ++row) {
+                const auto parent = nullptr == relation ? InvalidEntity : relation->GetTarget(entities[row]);
+                if (false == isChunkDirty && (InvalidEntity == parent || _runVersion != _stamps[parent.index])) {
+                    continue;
+                }
+
+                const auto* parentWorld = InvalidEntity == parent ? nullptr : parentWorlds.Get(parent);
+                worlds[row].value = nullptr == parentWorld ? locals[row].value : parentWorld->value * locals[row].value;
+                _stamps[entities[row].index] = _runVersion;
+                isWritten = true;
+                ++result;
+            }
+        }
+        return result;
+    }
+}
@@ -0,0 +1,73 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/query.h>
+#include <ECS/async.h>
+
+namespace ECS {
+    struct LocalToParent {
+        glm::mat4 value;
+    };
+    struct LocalToWorld {
+        glm::mat4 value;
+    };
+    // Shared, so every depth is a run of its own chunks and a level is swept chunk by chunk.
+    struct HierarchyDepth {
+        uint32_t  value;
+    };
+
+    //=================================================================================================================
+    // TransformHierarchy
+    // Parents are ChildOf relations. Run propagates LocalToWorld one depth at a time, the chunks of a level in
+    // parallel, since a level only reads the level above. An entity is recomputed when its chunk's LocalToParent
+    // changed since the last run or its parent was recomputed in this one, so clean subtrees are skipped, and only
+    // chunks with a recomputed row are marked, so Changed<LocalToWorld>() wakes for those alone.
+    //=================================================================================================================
+    class TransformHierarchy {
+    public:
+        // Component and header types an archetype needs to take part.
+        [[nodiscard]] static HashSizePairs GetHashSizePairs();
+        [[nodiscard]] static HeaderDesc    GetHeaderDesc();
+        [[nodiscard]] static Hashes        GetHashes();
+
+        // InvalidEntity makes child a root. A parent inside child's own subtree is refused.
+        void                               SetParent(Engine& engine, Entity child, Entity parent);
+        void                               Run(Engine& engine, JobSystem& jobs);
+        // The same as a coroutine for a Scheduler, awaiting each level instead of blocking on it.
+        [[nodiscard]] AsyncTask            RunAsync(Engine& engine, JobSystem& jobs);
+
+        [[nodiscard]] constexpr uint32_t   GetMaxDepth() const noexcept { return _maxDepth; }
+        [[nodiscard]] constexpr size_t     GetNumUpdated() const noexcept { return _numUpdated; }
+
+    private:
+        // LocalToWorld is written through the tasks, so the query itself marks nothing.
+        using QueryType = Query<const LocalToParent, const LocalToWorld>;
+
+        struct Task {
+            const BodyHandler*             handler = nullptr;
+            std::span<const Entity>        entities;
+            std::span<const LocalToParent> locals;
+            std::span<LocalToWorld>        worlds;
+            bool                           isWritten = false;
+        };
+
+        void                               BeginRun(Engine& engine);
+        void                               RefreshMaxDepth();
+        [[nodiscard]] JobHandle            ScheduleLevel(const Engine& engine, JobSystem& jobs, uint32_t depth);
+        void                               EndLevel();
+        [[nodiscard]] static uint32_t      GetDepth(const Engine& engine, Entity entity);
+        size_t                             RunTasks(const Engine& engine, size_t begin, size_t end);
+
+        std::optional<QueryType>           _query;
+        std::vector<Task>                  _tasks;
+        std::vector<ChangeVersion>         _stamps;
+
+        uint32_t                           _maxDepth = 0;
+        size_t                             _numDirty = 0;
+        std::atomic<size_t>                _levelDirty = 0;
+        size_t                             _numUpdated = 0;
+        ChangeVersion                      _runVersion = 0;
+        ChangeVersion                      _lastVersion = 0;
+    };
+}
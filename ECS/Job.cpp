@@ -0,0 +1,112 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#include <pch.h>
+#include "job.h"
+
+namespace ECS {
+    JobSystem::JobSystem(size_t numWorkers) {
+        for (size_t i = 0; i < numWorkers; ++i) {
+            _workers.emplace_back([this] { WorkerLoop(); });
+        }
+    }
+
+    JobSystem::~JobSystem() {
+        {
+            std::lock_guard lock(_mutex);
+            _isQuit = true;
+        }
+        _wake.notify_all();
+
+        for (auto& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    void JobSystem::ParallelFor(size_t count, size_t batchSize, const Job& job) {
+        if (0 == count) {
+            return;
+        }
+
+        if (_workers.empty() || count <= std::max<size_t>(1, batchSize)) {
+            job(0, count);
+            return;
+        }
+
+        const auto handle = std::make_shared<JobGroup>(count, batchSize, &job);
+        Push(handle);
+        Wait(handle);
+    }
+
+    JobHandle JobSystem::Schedule(size_t count, size_t batchSize, Job job) {
+        auto handle = std::make_shared<JobGroup>(count, batchSize, nullptr, std::move(job));
+        if (0 < count) {
+            Push(handle);
+        }
+        return handle;
+    }
+
+    void JobSystem::Wait(const JobHandle& handle) {
+        while (false == handle->IsDone()) {
+            if (RunBatch()) {
+                continue;
+            }
+
+            // Every batch is taken, the last ones are still running on workers.
+            std::unique_lock lock(_mutex);
+            _done.wait(lock, [&handle] { return handle->IsDone(); });
+        }
+    }
+
+    bool JobSystem::RunBatch() {
+        const auto group = FrontGroup();
+        if (nullptr == group) {
+            return false;
+        }
+
+        const auto begin = group->_next.fetch_add(group->_batchSize, std::memory_order_relaxed);
+        if (begin >= group->_count) {
+            return true;
+        }
+
+        const auto end = std::min(begin + group->_batchSize, group->_count);
+        (*group->_job)(begin, end);
+
+        if (end - begin == group->_remaining.fetch_sub(end - begin, std::memory_order_acq_rel)) {
+            std::lock_guard lock(_mutex);
+            _done.notify_all();
+        }
+        return true;
+    }
+
+    void JobSystem::Push(const JobHandle& handle) {
+        {
+            std::lock_guard lock(_mutex);
+            _groups.emplace_back(handle);
+        }
+        _wake.notify_all();
+    }
+
+    JobHandle JobSystem::FrontGroup() {
+        std::lock_guard lock(_mutex);
+        while (false == _groups.empty() && _groups.front()->IsTaken()) {
+            _groups.pop_front();
+        }
+        return _groups.empty() ? nullptr : _groups.front();
+    }
+
+    void JobSystem::WorkerLoop() {
+        while (true) {
+            if (RunBatch()) {
+                continue;
+            }
+
+            std::unique_lock lock(_mutex);
+            _wake.wait(lock, [this] {
+                return _isQuit || std::ranges::any_of(_groups, [](const auto& group) { return false == group->IsTaken(); });
+            });
+            if (_isQuit) {
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+namespace ECS {
+    //=================================================================================================================
+    // JobGroup
+    // One scheduled loop : batches of [0, count) handed out first come first served, done once every item ran.
+    //=================================================================================================================
+    using Job = std::function<void(size_t /*begin*/, size_t /*end*/)>;
+
+    class JobGroup {
+    public:
+        JobGroup(size_t count, size_t batchSize, const Job* job, Job&& owned = {})
+            : _owned(std::move(owned)), _job(nullptr == job ? &_owned : job)
+            , _count(count), _batchSize(std::max<size_t>(1, batchSize)), _remaining(count) {
+        }
+
+        [[nodiscard]] bool IsDone() const noexcept { return 0 == _remaining.load(std::memory_order_acquire); }
+        [[nodiscard]] bool IsTaken() const noexcept { return _next.load(std::memory_order_relaxed) >= _count; }
+
+    private:
+        friend class JobSystem;
+
+        const Job                       _owned;
+        const Job*                      _job = nullptr;
+        const size_t                    _count = 0;
+        const size_t                    _batchSize = 1;
+        std::atomic<size_t>             _next = 0;
+        std::atomic<size_t>             _remaining = 0;
+    };
+
+    using JobHandle = std::shared_ptr<JobGroup>;
+
+    //=================================================================================================================
+    // JobSystem
+    // Fixed pool of worker threads taking batches from a queue of groups. Schedule returns at once; Wait and
+    // ParallelFor make the calling thread run batches too until their group is done, so they also work with no
+    // workers at all.
+    //=================================================================================================================
+    class JobSystem {
+    public:
+        explicit JobSystem(size_t numWorkers = std::max(1u, std::thread::hardware_concurrency()) - 1);
+        ~JobSystem();
+
+        JobSystem(const JobSystem&)            = delete;
+        JobSystem(JobSystem&&)                 = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+        JobSystem& operator=(JobSystem&&)      = delete;
+
+        // job(begin, end) over [0, count) in batches of batchSize. Blocks until every batch is done.
+        void                            ParallelFor(size_t count, size_t batchSize, const Job& job);
+
+        // The same without blocking, job is kept by the group until it is done.
+        [[nodiscard]] JobHandle         Schedule(size_t count, size_t batchSize, Job job);
+        void                            Wait(const JobHandle& handle);
+        // Runs one pending batch on the calling thread, false when there was none.
+        bool                            RunBatch();
+
+        [[nodiscard]] size_t            GetNumThreads() const noexcept { return _workers.size() + 1; }
+
+    private:
+        void                            Push(const JobHandle& handle);
+        [[nodiscard]] JobHandle         FrontGroup();
+        void                            WorkerLoop();
+
+        std::vector<std::thread>        _workers;
+        std::mutex                      _mutex;
+        std::condition_variable         _wake;
+        std::condition_variable         _done;
+        std::deque<JobHandle>           _groups;
+        bool                            _isQuit = false;
+    };
+}
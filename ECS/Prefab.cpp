@@ -0,0 +1,39 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#include <pch.h>
+#include "prefab.h"
+
+namespace ECS {
+    Prefab::Prefab(size_t instanceIndex, const TypeInfo& typeInfo)
+        : _instanceIndex(instanceIndex)
+        , _types(typeInfo.GetTypes())
+        , _sharedTypes(typeInfo.GetHeaderTypes().begin(), std::ranges::find_if(typeInfo.GetHeaderTypes(), [&typeInfo](const auto& eachType)->bool {
+            return eachType.offset >= typeInfo.GetSharedSize();
+        }))
+        , _row(typeInfo.GetTotalSize() - EntityColumnSize, 0)
+        , _shared(typeInfo.GetSharedSize(), 0) {
+    }
+
+    BodyRef Prefab::Get(Hash hash) noexcept {
+        const auto findIterator = std::ranges::find(_types, hash, &Type::hash);
+        if (_types.end() == findIterator) {
+            return nullptr;
+        }
+
+        return &_row[findIterator->offset - EntityColumnSize];
+    }
+
+    BodyRef Prefab::GetShared(Hash hash) noexcept {
+        const auto findIterator = std::ranges::find(_sharedTypes, hash, &Type::hash);
+        if (_sharedTypes.end() == findIterator) {
+            return nullptr;
+        }
+
+        return &_shared[findIterator->offset];
+    }
+
+    void Prefab::SetSharedKey(SharedKey shared) {
+        std::ranges::fill(_shared, uint8_t{ 0 });
+        std::ranges::copy(shared.first(std::min(shared.size(), _shared.size())), _shared.begin());
+    }
+}
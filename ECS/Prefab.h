@@ -0,0 +1,40 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/chunk.h>
+
+namespace ECS {
+    using namespace Chunk;
+
+    //=================================================================================================================
+    // Prefab
+    // One detached row of an archetype plus its shared values. Instantiating it replicates the row bytes into
+    // chunk columns of a chunk holding the same shared values.
+    //=================================================================================================================
+    class Prefab {
+    public:
+        explicit Prefab(size_t instanceIndex, const TypeInfo& typeInfo);
+
+        [[nodiscard]] BodyRef                  Get(Hash hash) noexcept;
+        [[nodiscard]] BodyRef                  GetShared(Hash hash) noexcept;
+
+        [[nodiscard]] constexpr size_t         GetInstanceIndex() const noexcept { return _instanceIndex; }
+        [[nodiscard]] const uint8_t*           GetRow() const noexcept { return _row.data(); }
+        [[nodiscard]] uint8_t*                 GetRow() noexcept { return _row.data(); }
+        [[nodiscard]] SharedKey                GetSharedKey() const noexcept { return _shared; }
+        void                                   SetSharedKey(SharedKey shared);
+
+        template<typename T>
+        [[nodiscard]] T* Accept() noexcept {
+            return reinterpret_cast<T*>(Get(TypeHash<T>()));
+        }
+
+    private:
+        const size_t                           _instanceIndex = 0;
+        const Types                            _types;
+        const Types                            _sharedTypes;
+        std::vector<uint8_t>                   _row;
+        std::vector<uint8_t>                   _shared;
+    };
+}
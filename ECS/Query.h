@@ -0,0 +1,614 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/entity.h>
+#include <ECS/aggregate.h>
+#include <ECS/job.h>
+
+namespace ECS {
+    // entities starts at row start of handler, a chunk with disabled entities is handed out as several runs.
+    struct QueryChunk {
+        const BodyHandler*      handler = nullptr;
+        std::span<const Entity> entities;
+        BodyIndex               start = 0;
+
+        template<typename T>
+        [[nodiscard]] const T* GetShared() const noexcept {
+            return reinterpret_cast<const T*>(handler->FindShared(TypeHash<T>()));
+        }
+
+        template<typename T>
+        [[nodiscard]] T* GetChunkComponent() const noexcept {
+            return reinterpret_cast<T*>(handler->FindChunkComponent(TypeHash<T>()));
+        }
+
+        template<typename Aggregate>
+        [[nodiscard]] const Aggregate& GetAggregate() const {
+            return ECS::GetAggregate<Aggregate>(*handler);
+        }
+    };
+
+    //=================================================================================================================
+    // QueryTraits
+    // T is a required column handed out as T&. Optional<T> doesn't take part in matching and is handed out as
+    // T*, nullptr for entities of chunks without it.
+    //=================================================================================================================
+    template<typename T>
+    struct Optional {
+    };
+
+    template<typename T>
+    struct QueryTraits {
+        using Component                    = T;
+        using Reference                    = T&;
+        static constexpr bool IsOptional   = false;
+
+        __inline static Reference Fetch(T* column, size_t index) noexcept {
+            return column[index];
+        }
+    };
+
+    template<typename T>
+    struct QueryTraits<Optional<T>> {
+        using Component                    = T;
+        using Reference                    = T*;
+        static constexpr bool IsOptional   = true;
+
+        __inline static Reference Fetch(T* column, size_t index) noexcept {
+            return nullptr == column ? nullptr : column + index;
+        }
+    };
+
+    template<typename T>
+    using QueryComponent = typename QueryTraits<T>::Component;
+    template<typename T>
+    using QueryReference = typename QueryTraits<T>::Reference;
+
+    //=================================================================================================================
+    // Query
+    // Typed iteration over every chunk holding all of Ts. The hash list comes from Ts, so the column order
+    // always matches the template order. Const components are read only, the rest are written in place and
+    // bump the chunk's change version of that column. Changed<T>() skips chunks where none of the given columns
+    // were written since this query last ran, so keep the query alive between frames to make use of it.
+    // With/Without/Any are archetype filters, evaluated once when archetypes are matched, not per entity.
+    // Entities with a required hash disabled are skipped by a bit scan, chunks without any disabled are not scanned.
+    // Shared<T>(value) keeps chunks holding that shared value only, calling it again replaces the value.
+    // WithSparse/WithoutSparse test sparse set membership per entity, values are read through Engine::GetSparse.
+    // WithRelation<R>(target) keeps sources of that pair; for the sources alone RelationPool::GetSources is cheaper.
+    // WhereChunk<Aggregate>(predicate) skips chunks whose cached aggregate fails the predicate, before they are
+    // marked written, so a skipped chunk keeps its aggregate.
+    // Reduce folds the matching chunks on a JobSystem into one value that is the same from run to run.
+    // Structural changes (create/destroy) while iterating invalidate the columns.
+    //=================================================================================================================
+    template<typename... Ts>
+    class Query {
+        static_assert(sizeof...(Ts) > 0, "Query needs at least one component.");
+        static_assert(((false == std::is_empty_v<QueryComponent<Ts>>) && ...), "Tags have no column, filter them with With<T>().");
+
+    public:
+        using Columns         = std::tuple<QueryComponent<Ts>*...>;
+        using Reference       = std::tuple<QueryReference<Ts>...>;
+        using Handlers        = std::vector<const BodyHandler*>;
+        using SharedFilter    = std::pair<Hash, std::vector<uint8_t>>;
+        using SharedFilters   = std::vector<SharedFilter>;
+        using ChunkFilters    = std::vector<std::function<bool(const BodyHandler&)>>;
+        using SparseFilters   = std::vector<std::pair<const SparsePool*, bool>>;
+        using RelationFilters = std::vector<std::pair<const RelationPool*, Entity>>;
+
+        class Iterator {
+        public:
+            explicit Iterator(const Query& query) : _query(query) {
+                Seek();
+            }
+
+            [[nodiscard]] Reference operator*() const {
+                return std::apply([this](QueryComponent<Ts>*... columns) {
+                    return Reference{ QueryTraits<Ts>::Fetch(columns, _index)... };
+                }, _columns);
+            }
+
+            Iterator& operator++() {
+                ++_index;
+                if (_isFiltered) {
+                    _index = FindEnableBit(_enableBits.data(), _index, _count, true);
+                }
+
+                if (_index >= _count) {
+                    ++_handlerIndex;
+                    Seek();
+                }
+                return *this;
+            }
+
+            [[nodiscard]] bool operator==(std::default_sentinel_t) const noexcept {
+                return _handlerIndex >= _query._handlers.size();
+            }
+
+        private:
+            void Seek() {
+                for (; _handlerIndex < _query._handlers.size(); ++_handlerIndex) {
+                    const auto* handler = _query._handlers[_handlerIndex];
+                    if (false == _query.IsMatch(*handler)) {
+                        continue;
+                    }
+
+                    _count = handler->GetAllocCount();
+                    _isFiltered = _query.GetRowBits(*handler, _enableBits);
+                    _index = _isFiltered ? FindEnableBit(_enableBits.data(), 0, _count, true) : 0;
+                    if (_index >= _count) {
+                        continue;
+                    }
+
+                    _query.MarkWritten(*handler);
+                    _columns = GetColumns(*handler);
+                    return;
+                }
+            }
+
+            const Query&    _query;
+            size_t          _handlerIndex = 0;
+            Size            _index = 0;
+            Size            _count = 0;
+            Columns         _columns{};
+            bool            _isFiltered = false;
+            EnableBits      _enableBits;
+        };
+
+        explicit Query(Engine& engine) : _engine(engine) {
+            for (size_t i = 0; i < sizeof...(Ts); ++i) {
+                (IsOptional[i] ? _desc.optional : _desc.all).emplace_back(GetHashes()[i]);
+                if (false == IsOptional[i]) {
+                    // Header types are filtered with Shared<T>() or read with QueryChunk::GetShared<T>().
+                    _desc.columns.emplace_back(GetHashes()[i]);
+                }
+            }
+        }
+
+        template<typename T>
+        Query& Changed() {
+            _changedHashes.emplace_back(TypeHash<T>());
+            return *this;
+        }
+
+        template<typename... Us>
+        Query& With() {
+            (_desc.all.emplace_back(TypeHash<Us>()), ...);
+            _isMatched = false;
+            return *this;
+        }
+
+        template<typename... Us>
+        Query& Without() {
+            (_desc.none.emplace_back(TypeHash<Us>()), ...);
+            _isMatched = false;
+            return *this;
+        }
+
+        template<typename T>
+        Query& Shared(const T& value) {
+            const auto [hash, bytes] = MakeSharedValue(value);
+            const auto findIterator = std::ranges::find(_sharedFilters, hash, &SharedFilter::first);
+            if (_sharedFilters.end() != findIterator) {
+                findIterator->second.assign(bytes.begin(), bytes.end());
+                return *this;
+            }
+
+            _sharedFilters.emplace_back(hash, std::vector<uint8_t>{ bytes.begin(), bytes.end() });
+            _desc.all.emplace_back(hash);
+            _isMatched = false;
+            return *this;
+        }
+
+        template<typename... Us>
+        Query& WithSparse() {
+            (_sparseFilters.emplace_back(&_engine.GetSparse<Us>(), true), ...);
+            return *this;
+        }
+
+        template<typename... Us>
+        Query& WithoutSparse() {
+            (_sparseFilters.emplace_back(&_engine.GetSparse<Us>(), false), ...);
+            return *this;
+        }
+
+        template<typename R>
+        Query& WithRelation(Entity target) {
+            _relationFilters.emplace_back(&_engine.GetRelation<R>(), target);
+            return *this;
+        }
+
+        // Raw form : predicate(const BodyHandler&) decides from the chunk itself, e.g. its change versions.
+        Query& WhereChunk(std::function<bool(const BodyHandler&)>&& predicate) {
+            _chunkFilters.emplace_back(std::move(predicate));
+            return *this;
+        }
+
+        template<typename Aggregate, typename Predicate>
+        Query& WhereChunk(Predicate&& predicate) {
+            _chunkFilters.emplace_back([predicate = std::forward<Predicate>(predicate)](const BodyHandler& handler)->bool {
+                return predicate(GetAggregate<Aggregate>(handler));
+            });
+            return *this;
+        }
+
+        // Columns of the next selected chunk are requested into cache while the current one runs. Meant for the
+        // columns a sweep reads; streamed columns are left out.
+        template<typename... Us>
+        Query& Prefetch() {
+            ([this](const auto hash) {
+                if (std::ranges::find(_streamHashes, hash) == _streamHashes.end()) {
+                    _prefetchHashes.emplace_back(hash);
+                }
+            }(TypeHash<Us>()), ...);
+            return *this;
+        }
+
+        // Columns the sweep only writes, with non-temporal stores, so they are never prefetched. The query only
+        // records it : the kernel picks its stores, see StaticSystem::StreamTypes.
+        template<typename... Us>
+        Query& Stream() {
+            static_assert((IsWritableColumn<Us>() && ...), "Only written columns of the query can be streamed.");
+            ([this](const auto hash) {
+                _streamHashes.emplace_back(hash);
+                std::erase(_prefetchHashes, hash);
+            }(TypeHash<Us>()), ...);
+            return *this;
+        }
+
+        template<typename... Us>
+        Query& Any() {
+            (_desc.any.emplace_back(TypeHash<Us>()), ...);
+            _isMatched = false;
+            return *this;
+        }
+
+        // Chunk level matching alone, for drivers keeping per chunk results across runs. Sparse and relation filters
+        // work per row without a chunk version, a kept result can't be trusted while the query has any.
+        [[nodiscard]] bool IsChunkSelected(const BodyHandler& handler) const { return IsMatch(handler); }
+        // Archetypes the query matches, without starting a run or touching change versions.
+        const ConstInstanceRefs& MatchInstances() {
+            if (false == _isMatched || _numInstances != _engine.GetNumInstance()) {
+                _isMatched = true;
+                _numInstances = _engine.GetNumInstance();
+                _instances = _engine.CollectInstances(_desc);
+            }
+            return _instances;
+        }
+
+        [[nodiscard]] bool HasRowFilters() const noexcept { return false == _sparseFilters.empty() || false == _relationFilters.empty(); }
+
+        [[nodiscard]] constexpr Engine&          GetEngine() const noexcept { return _engine; }
+        [[nodiscard]] constexpr const QueryDesc& GetDesc() const noexcept { return _desc; }
+
+        [[nodiscard]] static const Hashes& GetHashes() {
+            static const Hashes hashes{ TypeHash<QueryComponent<Ts>>()... };
+            return hashes;
+        }
+
+        // Hashes of the non const components, the columns a run marks written.
+        [[nodiscard]] static const Hashes& GetWriteHashes() {
+            static const Hashes hashes = [] {
+                Hashes result;
+                for (size_t i = 0; i < sizeof...(Ts); ++i) {
+                    if (IsWritable[i]) {
+                        result.emplace_back(GetHashes()[i]);
+                    }
+                }
+                return result;
+            }();
+            return hashes;
+        }
+
+        [[nodiscard]] static Columns GetColumns(const BodyHandler& handler) {
+            return GetColumns(handler, std::index_sequence_for<Ts...>{});
+        }
+
+        // func(const QueryChunk&, std::span<Component>...) once per run of enabled entities of each non empty chunk,
+        // the whole chunk when nothing is disabled; absent optionals are empty spans.
+        template<typename Func>
+        void EachChunk(Func&& func) {
+            BeginChunks();
+            // The next selected chunk is found before the current one runs, so only chunks that will run are
+            // prefetched. Running a chunk only marks that chunk, the selection of the later ones stays the same.
+            auto next = FindSelected(0);
+            while (next < _handlers.size()) {
+                const auto& handler = *_handlers[next];
+                next = FindSelected(next + 1);
+                if (next < _handlers.size()) {
+                    PrefetchChunk(*_handlers[next]);
+                }
+                MarkWritten(handler);
+                InvokeChunk(handler, _enableBits, func);
+            }
+        }
+
+        // EachChunk in steps, for drivers that interleave several queries chunk by chunk : BeginChunks once per run,
+        // then RunChunk for each of the handlers it returned, in order. RunChunk is false when the chunk is filtered out.
+        const Handlers& BeginChunks() {
+            BeginRun();
+            return _handlers;
+        }
+
+        template<typename Func>
+        bool RunChunk(const BodyHandler& handler, Func&& func) {
+            if (false == IsMatch(handler)) {
+                return false;
+            }
+            MarkWritten(handler);
+            InvokeChunk(handler, _enableBits, func);
+            return true;
+        }
+
+        void PrefetchChunk(const BodyHandler& handler) const noexcept {
+            for (const auto hash : _prefetchHashes) {
+                handler.Prefetch(hash);
+            }
+        }
+
+        // reduce(Value& partial, const QueryChunk&, std::span<const Component>...) folds a run into a partial and
+        // combine(Value& into, const Value& from) merges two. Chunks are split in fixed batches reduced in parallel,
+        // then the partials are combined in chunk order, so the result is the same for any thread count or timing.
+        template<typename Value, typename ReduceFunc, typename CombineFunc>
+        [[nodiscard]] Value Reduce(JobSystem& jobs, const Value& identity, ReduceFunc&& reduce, CombineFunc&& combine) {
+            static_assert((std::is_const_v<QueryComponent<Ts>> && ...), "Reduce only reads, use const components.");
+
+            _matchedHandlers.clear();
+            for (const auto* handler : BeginChunks()) {
+                if (IsMatch(*handler)) {
+                    _matchedHandlers.emplace_back(handler);
+                }
+            }
+
+            const auto numBatches = (_matchedHandlers.size() + ReduceBatchSize - 1) / ReduceBatchSize;
+            std::vector<Value> partials(numBatches, identity);
+            jobs.ParallelFor(numBatches, 1, [this, &partials, &reduce](size_t begin, size_t end) {
+                EnableBits bits;
+                for (auto batch = begin; batch < end; ++batch) {
+                    auto& partial = partials[batch];
+                    const auto last = std::min(_matchedHandlers.size(), (batch + 1) * ReduceBatchSize);
+                    for (auto i = batch * ReduceBatchSize; i < last; ++i) {
+                        InvokeChunk(*_matchedHandlers[i], bits, [&partial, &reduce](const QueryChunk& chunk, std::span<QueryComponent<Ts>>... columns) {
+                            reduce(partial, chunk, columns...);
+                        });
+                    }
+                }
+            });
+
+            auto result = identity;
+            for (const auto& partial : partials) {
+                combine(result, partial);
+            }
+            return result;
+        }
+
+        // func(Reference...) or func(Entity, Reference...) once per entity, inlined into a plain loop over each chunk.
+        template<typename Func>
+        void Each(Func&& func) {
+            EachChunk([&func](const QueryChunk& chunk, std::span<QueryComponent<Ts>>... columns) {
+                ForEachEntity(func, chunk.entities.data(), chunk.entities.size(), columns.data()...);
+            });
+        }
+
+        [[nodiscard]] size_t Count() {
+            size_t result = 0;
+            for (const auto* handler : CollectHandlers()) {
+                if (false == IsChunkMatch(*handler)) {
+                    continue;
+                }
+
+                if (false == GetRowBits(*handler, _enableBits)) {
+                    result += handler->GetAllocCount();
+                    continue;
+                }
+
+                ForEachEnabledRun(_enableBits.data(), handler->GetAllocCount(), [&result](Size begin, Size end) {
+                    result += end - begin;
+                });
+            }
+            return result;
+        }
+
+        [[nodiscard]] Iterator begin() {
+            BeginRun();
+            return Iterator{ *this };
+        }
+
+        [[nodiscard]] std::default_sentinel_t end() const noexcept {
+            return {};
+        }
+
+    private:
+        static constexpr std::array<bool, sizeof...(Ts)> IsOptional{ QueryTraits<Ts>::IsOptional... };
+        static constexpr std::array<bool, sizeof...(Ts)> IsWritable{ (false == std::is_const_v<QueryComponent<Ts>>)... };
+        // Chunks per Reduce partial. Fixed, so the combine order never depends on the thread count.
+        static constexpr size_t ReduceBatchSize = 4;
+
+        template<size_t... Indices>
+        [[nodiscard]] static Columns GetColumns(const BodyHandler& handler, std::index_sequence<Indices...>) {
+            if constexpr (std::ranges::any_of(IsWritable, std::identity{})) {
+                handler.Detach();
+            }
+
+            const auto& hashes = GetHashes();
+            return { GetColumn<Ts>(handler, hashes[Indices])... };
+        }
+
+        // Const columns are read in place, a forked chunk is only copied for the ones written.
+        template<typename T>
+        [[nodiscard]] static QueryComponent<T>* GetColumn(const BodyHandler& handler, Hash hash) {
+            if constexpr (std::is_const_v<QueryComponent<T>>) {
+                return reinterpret_cast<QueryComponent<T>*>(handler.Read(hash));
+            }
+            else {
+                return reinterpret_cast<QueryComponent<T>*>(handler.Find(hash));
+            }
+        }
+
+        template<typename Func>
+        __inline static void ForEachEntity(Func& func, const Entity* entities, size_t count, QueryComponent<Ts>* __restrict... columns) {
+            for (size_t i = 0; i < count; ++i) {
+                if constexpr (std::is_invocable_v<Func&, Entity, QueryReference<Ts>...>) {
+                    func(entities[i], QueryTraits<Ts>::Fetch(columns, i)...);
+                }
+                else {
+                    func(QueryTraits<Ts>::Fetch(columns, i)...);
+                }
+            }
+        }
+
+        // Hands the chunk's runs of rows passing the row filters to func, bits is the scratch for them.
+        template<typename Func>
+        void InvokeChunk(const BodyHandler& handler, EnableBits& bits, Func&& func) const {
+            // Columns first, a copy on write moves the entity column along with them.
+            const auto columns = GetColumns(handler);
+            const auto entities = handler.GetEntities();
+            const auto invoke = [&func, &handler, &entities, &columns](Size begin, Size end) {
+                const QueryChunk chunk{ &handler, entities.subspan(begin, end - begin), begin };
+                std::apply([&func, &chunk, begin](QueryComponent<Ts>*... eachColumns) {
+                    func(chunk, std::span<QueryComponent<Ts>>{ nullptr == eachColumns ? nullptr : eachColumns + begin,
+                                                               nullptr == eachColumns ? 0 : chunk.entities.size() }...);
+                }, columns);
+            };
+
+            if (GetRowBits(handler, bits)) {
+                ForEachEnabledRun(bits.data(), handler.GetAllocCount(), invoke);
+            }
+            else {
+                invoke(0, handler.GetAllocCount());
+            }
+        }
+
+        template<typename U>
+        [[nodiscard]] static constexpr bool IsWritableColumn() {
+            return false == std::is_const_v<U> && (std::is_same_v<U, QueryComponent<Ts>> || ...);
+        }
+
+        // Index of the first handler from index the query selects, the handler count when none is left.
+        [[nodiscard]] size_t FindSelected(size_t index) const {
+            while (index < _handlers.size() && false == IsMatch(*_handlers[index])) {
+                ++index;
+            }
+            return index;
+        }
+
+        void BeginRun() {
+            _filterVersion = _lastVersion;
+            _lastVersion = _engine.IncrementChangeVersion();
+            CollectHandlers();
+        }
+
+        [[nodiscard]] bool IsMatch(const BodyHandler& handler) const {
+            if (handler.IsEmpty()) {
+                return false;
+            }
+
+            if (false == IsChunkMatch(handler)) {
+                return false;
+            }
+
+            return _changedHashes.empty() || std::ranges::any_of(_changedHashes, [this, &handler](const auto hash)->bool {
+                return handler.GetChangeVersion(hash) > _filterVersion;
+            });
+        }
+
+        // Enable bits of the required hashes and'ed with sparse membership, false when every row passes.
+        bool GetRowBits(const BodyHandler& handler, EnableBits& bits) const {
+            const auto isFiltered = handler.GetEnableBits(_desc.all, bits);
+            if (_sparseFilters.empty() && _relationFilters.empty()) {
+                return isFiltered;
+            }
+
+            const auto entities = handler.GetEntities();
+            if (false == isFiltered) {
+                bits.assign((handler.GetPackCount() + EnableWordBits - 1) / EnableWordBits, ~uint64_t{ 0 });
+            }
+
+            for (const auto& [pool, isRequired] : _sparseFilters) {
+                if (isRequired && pool->IsEmpty()) {
+                    std::ranges::fill(bits, uint64_t{ 0 });
+                    break;
+                }
+
+                for (size_t i = 0; i < entities.size(); ++i) {
+                    if (isRequired != pool->Has(entities[i])) {
+                        bits[i / EnableWordBits] &= ~(uint64_t{ 1 } << (i % EnableWordBits));
+                    }
+                }
+            }
+
+            for (const auto& [pool, target] : _relationFilters) {
+                for (size_t i = 0; i < entities.size(); ++i) {
+                    if (target != pool->GetTarget(entities[i])) {
+                        bits[i / EnableWordBits] &= ~(uint64_t{ 1 } << (i % EnableWordBits));
+                    }
+                }
+            }
+            return true;
+        }
+
+        [[nodiscard]] bool IsChunkMatch(const BodyHandler& handler) const {
+            return std::ranges::all_of(_sharedFilters, [&handler](const auto& filter)->bool {
+                const auto* shared = handler.FindShared(filter.first);
+                return nullptr != shared && std::equal(filter.second.begin(), filter.second.end(), shared);
+            }) && std::ranges::all_of(_chunkFilters, [&handler](const auto& filter)->bool {
+                return filter(handler);
+            });
+        }
+
+        void MarkWritten(const BodyHandler& handler) const {
+            for (const auto hash : GetWriteHashes()) {
+                handler.MarkChanged(hash, _lastVersion);
+            }
+        }
+
+        const Handlers& CollectHandlers() {
+            _handlers.clear();
+            for (const auto* instance : MatchInstances()) {
+                _handlers.insert(_handlers.end(), instance->GetHandlers().begin(), instance->GetHandlers().end());
+            }
+            return _handlers;
+        }
+
+        Engine&           _engine;
+        QueryDesc         _desc;
+        bool              _isMatched = false;
+        size_t            _numInstances = 0;
+        ConstInstanceRefs _instances;
+        Handlers          _handlers;
+        Handlers          _matchedHandlers;
+        EnableBits        _enableBits;
+
+        Hashes            _changedHashes;
+        SharedFilters     _sharedFilters;
+        ChunkFilters      _chunkFilters;
+        SparseFilters     _sparseFilters;
+        RelationFilters   _relationFilters;
+        Hashes            _prefetchHashes;
+        Hashes            _streamHashes;
+        ChangeVersion     _lastVersion = 0;
+        ChangeVersion     _filterVersion = 0;
+    };
+
+    template<typename... Ts, typename Func>
+    void Engine::Each(Func&& func) {
+        Query<Ts...>{ *this }.Each(std::forward<Func>(func));
+    }
+
+    // Replicates the prefab, then func(size_t index, Ts&...) overrides per instance columns.
+    template<typename... Ts, typename Func>
+    EntityRuns Engine::Instantiate(const Prefab& prefab, size_t count, Func&& func) {
+        auto result = Instantiate(prefab, count);
+
+        size_t index = 0;
+        for (const auto& entities : result) {
+            const auto* location = GetLocation(entities.front());
+            std::apply([&func, &entities, &index, start = location->index](Ts*... columns) {
+                for (size_t i = start; i < start + entities.size(); ++i) {
+                    func(index++, columns[i]...);
+                }
+            }, Query<Ts...>::GetColumns(*location->handler));
+        }
+        return result;
+    }
+}
@@ -0,0 +1,77 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#include <pch.h>
+#include "relation.h"
+
+namespace ECS {
+    void RelationPool::Set(Entity source, Entity target) {
+        if (const auto* exist = _targets.Get(source)) {
+            if (target == *exist) {
+                return;
+            }
+            RemoveSource(source, *exist);
+        }
+
+        _targets.Add(source, target);
+
+        auto& sources = _sources[target.index];
+        if (target != sources.target) {
+            sources = { target, {} };
+        }
+        sources.entities.emplace_back(source);
+    }
+
+    void RelationPool::Remove(Entity source) {
+        if (const auto* exist = _targets.Get(source)) {
+            RemoveSource(source, *exist);
+            _targets.Remove(source);
+        }
+    }
+
+    void RelationPool::Detach(Entity entity) {
+        Remove(entity);
+
+        const auto findIterator = _sources.find(entity.index);
+        if (_sources.end() == findIterator) {
+            return;
+        }
+
+        if (entity == findIterator->second.target) {
+            for (const auto source : findIterator->second.entities) {
+                _targets.Remove(source);
+            }
+        }
+        _sources.erase(findIterator);
+    }
+
+    Entity RelationPool::GetTarget(Entity source) const noexcept {
+        const auto* target = _targets.Get(source);
+        return nullptr == target ? InvalidEntity : *target;
+    }
+
+    std::span<const Entity> RelationPool::GetSources(Entity target) const noexcept {
+        const auto findIterator = _sources.find(target.index);
+        if (_sources.end() == findIterator || target != findIterator->second.target) {
+            return {};
+        }
+        return findIterator->second.entities;
+    }
+
+    void RelationPool::RemoveSource(Entity source, Entity target) {
+        const auto findIterator = _sources.find(target.index);
+        if (_sources.end() == findIterator) {
+            return;
+        }
+
+        auto& entities = findIterator->second.entities;
+        if (const auto sourceIterator = std::ranges::find(entities, source);
+            entities.end() != sourceIterator) {
+            *sourceIterator = entities.back();
+            entities.pop_back();
+        }
+
+        if (entities.empty()) {
+            _sources.erase(findIterator);
+        }
+    }
+}
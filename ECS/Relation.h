@@ -0,0 +1,56 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/sparseset.h>
+
+namespace ECS {
+    //=================================================================================================================
+    // Relation
+    // Pairs (R, target) : every source has at most one target per relation type, and a reverse index lists the
+    // sources of each target, so "everything whose parent is X" costs O(matches). A relation type declaring
+    // static constexpr bool IsCascade = true has its sources destroyed along with the target.
+    //=================================================================================================================
+    struct ChildOf {
+        static constexpr bool IsCascade = true;
+    };
+
+    template<typename R>
+    [[nodiscard]] constexpr bool IsCascadeRelation() noexcept {
+        if constexpr (requires { R::IsCascade; }) {
+            return R::IsCascade;
+        }
+        else {
+            return false;
+        }
+    }
+
+    class RelationPool {
+    public:
+        explicit RelationPool(bool isCascade) : _isCascade(isCascade) {
+        }
+
+        // Replaces the previous target of source.
+        void                                   Set(Entity source, Entity target);
+        void                                   Remove(Entity source);
+        // Drops entity both as a source and as a target, the sources of it lose their relation.
+        void                                   Detach(Entity entity);
+
+        [[nodiscard]] Entity                   GetTarget(Entity source) const noexcept;
+        [[nodiscard]] std::span<const Entity>  GetSources(Entity target) const noexcept;
+        [[nodiscard]] constexpr bool           IsCascade() const noexcept { return _isCascade; }
+        [[nodiscard]] constexpr const SparseSet<Entity>& GetTargets() const noexcept { return _targets; }
+
+    private:
+        struct Sources {
+            Entity                             target;
+            Entities                           entities;
+        };
+
+        void                                   RemoveSource(Entity source, Entity target);
+
+        const bool                             _isCascade = false;
+        SparseSet<Entity>                      _targets;
+        std::unordered_map<EntityIndex, Sources> _sources;
+    };
+}
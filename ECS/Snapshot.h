@@ -0,0 +1,170 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/query.h>
+
+namespace ECS {
+    //=================================================================================================================
+    // SnapshotFrame
+    // Copy of the snapshot components of every matching chunk as they were when it was published. It never changes
+    // after that, so any number of threads read it while the simulation writes the chunks themselves.
+    //=================================================================================================================
+    template<typename... Ts>
+    class SnapshotFrame {
+    public:
+        // func(Entity, const Ts&...)
+        template<typename Func>
+        void Each(Func&& func) const {
+            for (size_t i = 0; i < _numChunks; ++i) {
+                const auto& chunk = _chunks[i];
+                for (size_t row = 0; row < chunk.entities.size(); ++row) {
+                    std::apply([&func, &chunk, row](const auto&... columns) {
+                        func(chunk.entities[row], columns[row]...);
+                    }, chunk.columns);
+                }
+            }
+        }
+
+        // func(std::span<const Entity>, std::span<const Ts>...) once per chunk.
+        template<typename Func>
+        void EachChunk(Func&& func) const {
+            EachChunk(0, _numChunks, std::forward<Func>(func));
+        }
+
+        // The same over chunks [begin, end), to split a frame over jobs.
+        template<typename Func>
+        void EachChunk(size_t begin, size_t end, Func&& func) const {
+            for (size_t i = begin; i < std::min(end, _numChunks); ++i) {
+                const auto& chunk = _chunks[i];
+                std::apply([&func, &chunk](const auto&... columns) {
+                    func(std::span<const Entity>{ chunk.entities }, std::span<const Ts>{ columns }...);
+                }, chunk.columns);
+            }
+        }
+
+        // Number of the Publish that made it, from 1.
+        [[nodiscard]] constexpr uint64_t GetFrame() const noexcept { return _frame; }
+        [[nodiscard]] constexpr size_t   GetNumEntities() const noexcept { return _numEntities; }
+        [[nodiscard]] constexpr size_t   GetNumChunks() const noexcept { return _numChunks; }
+
+    private:
+        template<typename... Us>
+        friend class Snapshot;
+
+        struct Chunk {
+            const BodyHandler*                handler = nullptr;
+            ChangeVersion                     version = 0;
+            std::vector<Entity>               entities;
+            std::tuple<std::vector<Ts>...>    columns;
+        };
+
+        std::vector<Chunk>                    _chunks;
+        size_t                                _numChunks = 0;
+        size_t                                _numEntities = 0;
+        uint64_t                              _frame = 0;
+    };
+
+    //=================================================================================================================
+    // Snapshot
+    // Opt-in double buffering of a few components for readers on other threads, e.g. render extraction. Publish, on
+    // the simulation thread between frames, fills the back frame and swaps it to the front; readers Acquire the front
+    // and keep frame N while frame N + 1 is simulated. The back frame is reused once no reader holds it, and a chunk
+    // that is still selected and whose components and filter hashes are unchanged since that frame was filled is
+    // not copied again. Changes are the ones queries, enable toggles and structural changes record, the same as
+    // Changed<T>(); with sparse or relation filters every chunk is copied.
+    //=================================================================================================================
+    template<typename... Ts>
+    class Snapshot {
+        static_assert((std::is_trivially_copyable_v<Ts> && ...), "Chunk components must be trivially copyable.");
+
+    public:
+        using QueryType = Query<const Ts...>;
+        using Frame     = SnapshotFrame<Ts...>;
+
+        explicit Snapshot(Engine& engine) : _query(engine) {
+        }
+
+        // For archetype and row filters on which entities are kept, e.g. GetQuery().With<T>().
+        [[nodiscard]] constexpr QueryType& GetQuery() noexcept { return _query; }
+
+        void Publish() {
+            auto frame = AcquireBack();
+            frame->_numChunks = 0;
+            frame->_numEntities = 0;
+            frame->_frame = ++_numPublished;
+
+            const auto& handlers = _query.BeginChunks();
+            const auto version = _query.GetEngine().GetChangeVersion();
+            for (const auto* handler : handlers) {
+                if (frame->_numChunks == frame->_chunks.size()) {
+                    frame->_chunks.emplace_back();
+                }
+                auto& chunk = frame->_chunks[frame->_numChunks];
+
+                const auto isCopied = chunk.handler == handler && IsUnchanged(*handler, chunk.version);
+                if (false == isCopied && false == CopyChunk(*handler, chunk)) {
+                    continue;
+                }
+
+                chunk.handler = handler;
+                chunk.version = version;
+                frame->_numEntities += chunk.entities.size();
+                ++frame->_numChunks;
+            }
+
+            std::lock_guard lock(_mutex);
+            std::swap(_front, frame);
+            _back = std::move(frame);
+        }
+
+        // Any thread. nullptr before the first Publish.
+        [[nodiscard]] std::shared_ptr<const Frame> Acquire() const {
+            std::lock_guard lock(_mutex);
+            return _front;
+        }
+
+    private:
+        [[nodiscard]] std::shared_ptr<Frame> AcquireBack() {
+            std::lock_guard lock(_mutex);
+            if (nullptr == _back || 1 < _back.use_count()) {
+                return std::make_shared<Frame>();
+            }
+
+            // Pairs with the release of the last reader's reference.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return std::move(_back);
+        }
+
+        // The copy taken at version still holds : the chunk is still selected, and neither the snapshot columns
+        // nor the filter hashes, whose versions also record rows being disabled, changed since.
+        [[nodiscard]] bool IsUnchanged(const BodyHandler& handler, ChangeVersion version) const {
+            const auto isOlder = [&handler, version](const auto hash)->bool {
+                return handler.GetChangeVersion(hash) <= version;
+            };
+            return false == _query.HasRowFilters() && _query.IsChunkSelected(handler)
+                && std::ranges::all_of(_query.GetDesc().all, isOlder) && std::ranges::all_of(_query.GetDesc().optional, isOlder);
+        }
+
+        // False when the chunk has no row left after the query's filters.
+        bool CopyChunk(const BodyHandler& handler, typename Frame::Chunk& chunk) {
+            chunk.handler = nullptr;
+            chunk.entities.clear();
+            std::apply([](auto&... columns) { (columns.clear(), ...); }, chunk.columns);
+
+            _query.RunChunk(handler, [&chunk](const QueryChunk& run, std::span<const Ts>... runColumns) {
+                chunk.entities.insert(chunk.entities.end(), run.entities.begin(), run.entities.end());
+                std::apply([&runColumns...](auto&... columns) {
+                    (columns.insert(columns.end(), runColumns.begin(), runColumns.end()), ...);
+                }, chunk.columns);
+            });
+            return false == chunk.entities.empty();
+        }
+
+        QueryType                             _query;
+        mutable std::mutex                    _mutex;
+        std::shared_ptr<Frame>                _front;
+        std::shared_ptr<Frame>                _back;
+        uint64_t                              _numPublished = 0;
+    };
+}
@@ -0,0 +1,110 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/type.h>
+
+namespace ECS {
+    //=================================================================================================================
+    // SparseSet
+    // Storage outside the chunks for components added and removed at high frequency : a dense array of values,
+    // the dense array of their entities and a sparse entity index -> dense index table. Add and remove are O(1)
+    // and never move a chunk row or split an archetype.
+    //=================================================================================================================
+    class SparsePool {
+    public:
+        SparsePool()                             = default;
+        SparsePool(SparsePool&&)                 = delete;
+        virtual ~SparsePool()                    = default;
+        SparsePool& operator=(const SparsePool&) = delete;
+        SparsePool& operator=(SparsePool&&)      = delete;
+
+        [[nodiscard]] bool Has(Entity entity) const noexcept {
+            return entity.index < _sparse.size() && _sparse[entity.index] < _entities.size() && _entities[_sparse[entity.index]] == entity;
+        }
+
+        virtual void                                   Remove(Entity entity) = 0;
+        virtual void                                   Clear() = 0;
+        [[nodiscard]] virtual std::unique_ptr<SparsePool> Clone() const = 0;
+
+        [[nodiscard]] constexpr bool                   IsEmpty() const noexcept { return _entities.empty(); }
+        [[nodiscard]] constexpr size_t                 GetSize() const noexcept { return _entities.size(); }
+        [[nodiscard]] constexpr const Entities&        GetEntities() const noexcept { return _entities; }
+
+    protected:
+        SparsePool(const SparsePool&)            = default;
+
+        using DenseIndex                             = uint32_t;
+        static constexpr DenseIndex InvalidDenseIndex = std::numeric_limits<DenseIndex>::max();
+
+        std::vector<DenseIndex>                        _sparse;
+        Entities                                       _entities;
+    };
+
+    template<typename T>
+    class SparseSet final : public SparsePool {
+    public:
+        // Overwrites the value when the entity already has one.
+        T& Add(Entity entity, const T& value = {}) {
+            if (auto* exist = Get(entity)) {
+                return *exist = value;
+            }
+
+            if (entity.index >= _sparse.size()) {
+                _sparse.resize(static_cast<size_t>(entity.index) + 1, InvalidDenseIndex);
+            }
+            _sparse[entity.index] = static_cast<DenseIndex>(_entities.size());
+            _entities.emplace_back(entity);
+            return _values.emplace_back(value);
+        }
+
+        void Remove(Entity entity) override {
+            if (false == Has(entity)) {
+                return;
+            }
+
+            const auto index = _sparse[entity.index];
+            _sparse[_entities.back().index] = index;
+            _entities[index] = _entities.back();
+            _values[index] = std::move(_values.back());
+
+            _sparse[entity.index] = InvalidDenseIndex;
+            _entities.pop_back();
+            _values.pop_back();
+        }
+
+        void Clear() override {
+            for (const auto entity : _entities) {
+                _sparse[entity.index] = InvalidDenseIndex;
+            }
+            _entities.clear();
+            _values.clear();
+        }
+
+        [[nodiscard]] std::unique_ptr<SparsePool> Clone() const override {
+            return std::make_unique<SparseSet>(*this);
+        }
+
+        [[nodiscard]] T* Get(Entity entity) noexcept {
+            return Has(entity) ? &_values[_sparse[entity.index]] : nullptr;
+        }
+
+        [[nodiscard]] const T* Get(Entity entity) const noexcept {
+            return Has(entity) ? &_values[_sparse[entity.index]] : nullptr;
+        }
+
+        [[nodiscard]] std::span<T>       GetValues() noexcept { return _values; }
+        [[nodiscard]] std::span<const T> GetValues() const noexcept { return _values; }
+
+        // func(Entity, T&) over the dense arrays, O(size) however many entities live in chunks.
+        template<typename Func>
+        void Each(Func&& func) {
+            for (size_t i = 0; i < _values.size(); ++i) {
+                func(_entities[i], _values[i]);
+            }
+        }
+
+    private:
+        std::vector<T>                                 _values;
+    };
+}
@@ -4,12 +4,20 @@
 #include "system.h"
 
 namespace ECS {
-    System::System(Hashes&& hashes) : _hashes(std::move(hashes)) {
+    System::System(Hashes&& hashes, QueryDesc&& filter) : _desc(std::move(filter)), _hashes(std::move(hashes)) {
+        _desc.all.insert(_desc.all.end(), _hashes.begin(), _hashes.end());
+        _desc.columns.insert(_desc.columns.end(), _hashes.begin(), _hashes.end());
+        _hashes.insert(_hashes.end(), _desc.optional.begin(), _desc.optional.end());
     }
 
     void System::Run(Engine& engine, float delta) {
-        for (const auto* instance : engine.CollectInstances(_hashes)) {
-            for (const auto& collector : instance->GenerateCollector(_hashes)) {
+        const auto version = engine.IncrementChangeVersion();
+        for (const auto* instance : engine.CollectInstances(_desc)) {
+            for (const auto& collector : instance->GenerateCollector(_hashes, _desc.all)) {
+                // The virtual path can't tell reads from writes, every column counts as written.
+                for (const auto hash : _hashes) {
+                    collector.handler->MarkChanged(hash, version);
+                }
                 ForEach(engine, collector, delta);
             }
         }
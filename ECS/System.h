@@ -3,11 +3,13 @@
 #pragma once
 
 #include <ECS/entity.h>
+#include <ECS/query.h>
 
 namespace ECS {
     class System {
     public:
-        System(Hashes&& hashes);
+        // Collector refs follow hashes then filter.optional; filter.all adds required hashes without refs.
+        System(Hashes&& hashes, QueryDesc&& filter = {});
 
         System(const System&)            = default;
         System(System&&)                 = default;
@@ -20,38 +22,12 @@ namespace ECS {
     protected:
         virtual void ForEach(Engine& /*engine*/, const Collector& /*collector*/, float /*delta*/) {};
 
+        QueryDesc    _desc;
         Hashes       _hashes;
 
-        template<typename T1>
-        __inline T1* Accept(const Collector& collector) const noexcept {
-            return reinterpret_cast<T1*>(collector.refs[0]);
-        }
-
-        template<typename T1, typename T2>
-        __inline std::pair<T1*, T2*> Accept(const Collector& collector) const noexcept {
-            return {
-                reinterpret_cast<T1*>(collector.refs[0]),
-                reinterpret_cast<T2*>(collector.refs[1]),
-            };
-        }
-
-        template<typename T1, typename T2, typename T3>
-        __inline std::tuple<T1*, T2*, T3*> Accept(const Collector& collector) const noexcept {
-            return {
-                reinterpret_cast<T1*>(collector.refs[0]),
-                reinterpret_cast<T2*>(collector.refs[1]),
-                reinterpret_cast<T3*>(collector.refs[2]),
-            };
-        }
-
-        template<typename T1, typename T2, typename T3, typename T4>
-        __inline std::tuple<T1*, T2*, T3*, T4*> Accept(const Collector& collector) const noexcept {
-            return {
-                reinterpret_cast<T1*>(collector.refs[0]),
-                reinterpret_cast<T2*>(collector.refs[1]),
-                reinterpret_cast<T3*>(collector.refs[2]),
-                reinterpret_cast<T4*>(collector.refs[3]),
-            };
+        template<typename... Ts>
+        __inline auto Accept(const Collector& collector) const noexcept {
+            return Chunk::Accept<Ts...>(collector.refs);
         }
     };
 }
@@ -12,10 +12,49 @@ namespace ECS {
     };
     using Types     = std::vector<Type>;
 
+    using EntityIndex   = uint32_t;
+    using EntityVersion = uint32_t;
+    struct Entity {
+        EntityIndex   index   = std::numeric_limits<EntityIndex>::max();
+        EntityVersion version = 0;
+
+        [[nodiscard]] constexpr bool operator==(const Entity&) const noexcept = default;
+    };
+    using Entities                = std::vector<Entity>;
+
+    using ChangeVersion = uint32_t;
+    constexpr Entity InvalidEntity{};
+
     using Hashes              = std::vector<Hash>;
     using Sizes               = std::vector<Size>;
     using HashSizePair        = std::pair<Hash, Size>;
     using HashSizePairs       = std::vector<HashSizePair>;
     using HashSizePairsKeys   = std::ranges::keys_view<std::ranges::ref_view<HashSizePairs>>;
     using HashSizePairsValues = std::ranges::values_view<std::ranges::ref_view<HashSizePairs>>;
+
+    template<typename T>
+    [[nodiscard]] Hash TypeHash() noexcept {
+        return typeid(std::remove_cvref_t<T>).hash_code();
+    }
+
+    // Empty structs are tags : registered with size 0 they live in the archetype signature only, without a column.
+    template<typename T>
+    [[nodiscard]] constexpr Size TypeSize() noexcept {
+        return std::is_empty_v<T> ? 0 : static_cast<Size>(sizeof(T));
+    }
+
+    template<typename T>
+    [[nodiscard]] HashSizePair TypeHashSize() noexcept {
+        return { TypeHash<T>(), TypeSize<T>() };
+    }
+
+    // Value of a shared component, as bytes of the caller's object; only valid while that object is.
+    using SharedValue  = std::pair<Hash, std::span<const uint8_t>>;
+    using SharedValues = std::vector<SharedValue>;
+
+    template<typename T>
+    [[nodiscard]] SharedValue MakeSharedValue(const T& value) noexcept {
+        static_assert(std::is_trivially_copyable_v<T>, "Shared components are compared by bytes.");
+        return { TypeHash<T>(), { reinterpret_cast<const uint8_t*>(&value), sizeof(T) } };
+    }
 }
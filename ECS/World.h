@@ -0,0 +1,184 @@
+// Copyright 2013-2022 AFI, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <ECS/system.h>
+
+namespace ECS {
+    //=================================================================================================================
+    // StaticSystem
+    // CRTP system : Derived provides ForEach(float delta, Ts&...) or its own ForEachChunk(...), which is called
+    // without any virtual dispatch, so the kernel can be inlined into the chunk loop.
+    // Derived may also hide Configure(QueryType&) to add filters, e.g. query.Changed<T>(), BeginFrame(float) for
+    // per frame setup, LookupTypes to list the components it reads from other entities' rows, and StreamTypes to
+    // list the columns it only writes, which are then never prefetched and which its kernel, asking IsStreamed<T>(),
+    // stores with non-temporal stores.
+    //=================================================================================================================
+    template<typename Derived, typename... Ts>
+    class StaticSystem {
+    public:
+        using QueryType   = Query<Ts...>;
+        using LookupTypes = std::tuple<>;
+        using StreamTypes = std::tuple<>;
+
+        static void Configure(QueryType&) {
+        }
+
+        void BeginFrame(float) {
+        }
+
+        void Run(Engine& engine, float delta) {
+            auto& self = static_cast<Derived&>(*this);
+            self.BeginFrame(delta);
+            Prepare(engine).EachChunk(MakeChunkFunc(delta));
+        }
+
+        QueryType& Prepare(Engine& engine) {
+            if (false == _query.has_value() || &_query->GetEngine() != &engine) {
+                auto& query = _query.emplace(engine);
+                Derived::Configure(query);
+                [&query]<typename... Us>(std::tuple<Us...>*) {
+                    query.template Stream<Us...>();
+                }(static_cast<typename Derived::StreamTypes*>(nullptr));
+            }
+            return *_query;
+        }
+
+        // One chunk of a pass started by Prepare(engine).BeginChunks(), see Fused.
+        void RunChunk(const BodyHandler& handler, float delta) {
+            _query->RunChunk(handler, MakeChunkFunc(delta));
+        }
+
+        // Skips a chunk the query won't run, ahead of the frame's writes to it; a hint either way.
+        void PrefetchChunk(const BodyHandler& handler) const {
+            if (_query->IsChunkSelected(handler)) {
+                _query->PrefetchChunk(handler);
+            }
+        }
+
+        template<typename U>
+        [[nodiscard]] static constexpr bool IsStreamed() {
+            return []<typename... Us>(std::tuple<Us...>*) {
+                return (std::is_same_v<U, Us> || ...);
+            }(static_cast<typename Derived::StreamTypes*>(nullptr));
+        }
+
+        [[nodiscard]] static const Hashes& GetWriteHashes() {
+            return QueryType::GetWriteHashes();
+        }
+
+        __inline void ForEachChunk(const QueryChunk& chunk, float delta, QueryComponent<Ts>* __restrict... columns) {
+            auto& self = static_cast<Derived&>(*this);
+            const auto count = chunk.entities.size();
+            for (size_t i = 0; i < count; ++i) {
+                self.ForEach(delta, QueryTraits<Ts>::Fetch(columns, i)...);
+            }
+        }
+
+    private:
+        [[nodiscard]] auto MakeChunkFunc(float delta) {
+            return [&self = static_cast<Derived&>(*this), delta](const QueryChunk& chunk, std::span<QueryComponent<Ts>>... columns) {
+                self.ForEachChunk(chunk, delta, columns.data()...);
+            };
+        }
+
+        std::optional<QueryType> _query;
+    };
+
+    //=================================================================================================================
+    // Fused
+    // StaticSystems run chunk major : all of them on the first chunk, then all of them on the next, so a chunk is
+    // loaded once per frame instead of once per system. Order per chunk is template order, and a later system's
+    // Changed<T>() sees what an earlier one wrote to the same chunk.
+    // Only fused when every query matches the same archetypes and no system reads, through LookupTypes, a component
+    // another one writes, since rows of other chunks would be seen ahead of or behind the serial order; otherwise
+    // they run one after another, the same as listing them in World.
+    //=================================================================================================================
+    template<typename... Systems>
+    class Fused {
+    public:
+        explicit Fused(Systems&... systems) : _systems(systems...) {
+            std::array<Hashes, sizeof...(Systems)> lookups;
+            std::array<Hashes, sizeof...(Systems)> writes;
+            size_t index = 0;
+            ([&lookups, &writes, &index]<typename System>(System*) {
+                lookups[index] = MakeHashes(static_cast<typename System::LookupTypes*>(nullptr));
+                writes[index++] = System::GetWriteHashes();
+            }(static_cast<Systems*>(nullptr)), ...);
+
+            for (size_t reader = 0; reader < sizeof...(Systems); ++reader) {
+                for (size_t writer = 0; writer < sizeof...(Systems); ++writer) {
+                    _isFusable = _isFusable && (reader == writer || std::ranges::none_of(lookups[reader], [&writes, writer](const auto hash)->bool {
+                        return std::ranges::find(writes[writer], hash) != writes[writer].end();
+                    }));
+                }
+            }
+        }
+
+        void Run(Engine& engine, float delta) {
+            const auto isFused = _isFusable && std::apply([&engine](auto& first, auto&... rest) {
+                const auto& instances = first.Prepare(engine).MatchInstances();
+                return ((rest.Prepare(engine).MatchInstances() == instances) && ...);
+            }, _systems);
+
+            if (false == isFused) {
+                std::apply([&engine, delta](auto&... systems) {
+                    (systems.Run(engine, delta), ...);
+                }, _systems);
+                return;
+            }
+
+            std::apply([&engine, delta](auto& first, auto&... rest) {
+                first.BeginFrame(delta);
+                (rest.BeginFrame(delta), ...);
+
+                const auto& chunks = first.Prepare(engine).BeginChunks();
+                (rest.Prepare(engine).BeginChunks(), ...);
+
+                for (size_t i = 0; i < chunks.size(); ++i) {
+                    if (i + 1 < chunks.size()) {
+                        first.PrefetchChunk(*chunks[i + 1]);
+                        (rest.PrefetchChunk(*chunks[i + 1]), ...);
+                    }
+                    first.RunChunk(*chunks[i], delta);
+                    (rest.RunChunk(*chunks[i], delta), ...);
+                }
+            }, _systems);
+        }
+
+        [[nodiscard]] constexpr bool IsFusable() const noexcept { return _isFusable; }
+
+    private:
+        template<typename... Us>
+        [[nodiscard]] static Hashes MakeHashes(std::tuple<Us...>*) {
+            return { TypeHash<Us>()... };
+        }
+
+        std::tuple<Systems&...> _systems;
+        bool                    _isFusable = true;
+    };
+
+    //=================================================================================================================
+    // World
+    // Frame pipeline fixed at compile time. Systems run in template order; an ECS::System& entry keeps the
+    // virtual path for systems only known at runtime.
+    //=================================================================================================================
+    template<typename... Systems>
+    class World {
+    public:
+        explicit World(Engine& engine, Systems&... systems) : _engine(engine), _systems(systems...) {
+        }
+
+        void Run(float delta) {
+            std::apply([this, delta](auto&... systems) {
+                (systems.Run(_engine, delta), ...);
+            }, _systems);
+        }
+
+        [[nodiscard]] constexpr Engine& GetEngine() const noexcept { return _engine; }
+
+    private:
+        Engine&                  _engine;
+        std::tuple<Systems&...>  _systems;
+    };
+}
@@ -0,0 +1,242 @@
+// Copyright 2011-2021 GameParadiso, Inc. All Rights Reserved.
+
+#pragma once
+
+namespace Math::Batch {
+    //=================================================================================================================
+    // ComposeTRS
+    // transform = translate * rotate * scale, written straight from the quaternion instead of through three
+    // matrices and two products. Four transforms per step on SSE with the columns transposed in registers; the
+    // tail and non SSE builds take the scalar path. Rotations are expected to be normalized.
+    //=================================================================================================================
+    constexpr size_t Width = 4;
+
+    // Rows of the affine matrix without the constant (0, 0, 0, 1), the usual per instance layout for shaders.
+    using Affine = glm::mat3x4;
+
+    // Stream writes around the cache with non-temporal stores, for output nobody reads again this frame. Needs a
+    // 16 byte aligned destination, otherwise it falls back to cached stores.
+    enum class StoreHint {
+        Cached,
+        Stream,
+    };
+
+    namespace Detail {
+        // columns[j] = j-th column of rotate * scale.
+        __inline void ComposeRS(const glm::vec3& scale, const glm::quat& rotation, glm::vec3 (&columns)[3]) noexcept {
+            const auto x2 = rotation.x + rotation.x, y2 = rotation.y + rotation.y, z2 = rotation.z + rotation.z;
+            const auto xx = rotation.x * x2, yy = rotation.y * y2, zz = rotation.z * z2;
+            const auto xy = rotation.x * y2, xz = rotation.x * z2, yz = rotation.y * z2;
+            const auto wx = rotation.w * x2, wy = rotation.w * y2, wz = rotation.w * z2;
+
+            columns[0] = glm::vec3{ 1.0f - (yy + zz), xy + wz, xz - wy } * scale.x;
+            columns[1] = glm::vec3{ xy - wz, 1.0f - (xx + zz), yz + wx } * scale.y;
+            columns[2] = glm::vec3{ xz + wy, yz - wx, 1.0f - (xx + yy) } * scale.z;
+        }
+
+        __inline void ComposeTRS(const glm::vec3& scale, const glm::quat& rotation, const glm::vec3& translation, glm::mat4& transform) noexcept {
+            glm::vec3 columns[3];
+            ComposeRS(scale, rotation, columns);
+
+            transform[0] = glm::vec4{ columns[0], 0.0f };
+            transform[1] = glm::vec4{ columns[1], 0.0f };
+            transform[2] = glm::vec4{ columns[2], 0.0f };
+            transform[3] = glm::vec4{ translation, 1.0f };
+        }
+
+        __inline void ComposeTRS(const glm::vec3& scale, const glm::quat& rotation, const glm::vec3& translation, Affine& transform) noexcept {
+            glm::vec3 columns[3];
+            ComposeRS(scale, rotation, columns);
+
+            for (glm::length_t row = 0; row < 3; ++row) {
+                transform[row] = glm::vec4{ columns[0][row], columns[1][row], columns[2][row], translation[row] };
+            }
+        }
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        // Twelve packed floats of four vec3 into x, y and z lanes.
+        __inline void LoadVec3(const glm::vec3* source, glm_vec4& x, glm_vec4& y, glm_vec4& z) noexcept {
+            const auto* floats = &source->x;
+            const auto v0 = _mm_loadu_ps(floats);
+            const auto v1 = _mm_loadu_ps(floats + 4);
+            const auto v2 = _mm_loadu_ps(floats + 8);
+
+            x = _mm_shuffle_ps(v0, _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+            y = _mm_shuffle_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+            z = _mm_shuffle_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2)), v2, _MM_SHUFFLE(3, 0, 2, 0));
+        }
+
+        // matrix[row][column] of four transforms, column 3 is the translation.
+        __inline void ComposeTRS(const glm::vec3* scales, const glm::quat* rotations, const glm::vec3* translations, glm_vec4 (&matrix)[3][4]) noexcept {
+            auto q0 = _mm_loadu_ps(&rotations[0][0]);
+            auto q1 = _mm_loadu_ps(&rotations[1][0]);
+            auto q2 = _mm_loadu_ps(&rotations[2][0]);
+            auto q3 = _mm_loadu_ps(&rotations[3][0]);
+            _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+#ifdef GLM_FORCE_QUAT_DATA_XYZW
+            const auto x = q0, y = q1, z = q2, w = q3;
+#else
+            const auto w = q0, x = q1, y = q2, z = q3;
+#endif
+
+            const auto x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+            const auto xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+            const auto xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+            const auto wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+            const auto one = _mm_set1_ps(1.0f);
+
+            glm_vec4 sx, sy, sz;
+            LoadVec3(scales, sx, sy, sz);
+
+            matrix[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+            matrix[1][0] = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+            matrix[2][0] = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+            matrix[0][1] = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+            matrix[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+            matrix[2][1] = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+            matrix[0][2] = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+            matrix[1][2] = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+            matrix[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+
+            LoadVec3(translations, matrix[0][3], matrix[1][3], matrix[2][3]);
+        }
+
+        template<bool IsStream>
+        __inline void StoreVector(float* dest, glm_vec4 value) noexcept {
+            if constexpr (IsStream) {
+                _mm_stream_ps(dest, value);
+            }
+            else {
+                _mm_storeu_ps(dest, value);
+            }
+        }
+
+        template<bool IsStream>
+        __inline void Store(const glm_vec4 (&matrix)[3][4], glm::mat4* transforms) noexcept {
+            for (glm::length_t column = 0; column < 4; ++column) {
+                auto r0 = matrix[0][column], r1 = matrix[1][column], r2 = matrix[2][column];
+                auto r3 = _mm_set1_ps(3 == column ? 1.0f : 0.0f);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+                StoreVector<IsStream>(&transforms[0][column][0], r0);
+                StoreVector<IsStream>(&transforms[1][column][0], r1);
+                StoreVector<IsStream>(&transforms[2][column][0], r2);
+                StoreVector<IsStream>(&transforms[3][column][0], r3);
+            }
+        }
+
+        template<bool IsStream>
+        __inline void Store(const glm_vec4 (&matrix)[3][4], Affine* transforms) noexcept {
+            for (glm::length_t row = 0; row < 3; ++row) {
+                auto c0 = matrix[row][0], c1 = matrix[row][1], c2 = matrix[row][2], c3 = matrix[row][3];
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+                StoreVector<IsStream>(&transforms[0][row][0], c0);
+                StoreVector<IsStream>(&transforms[1][row][0], c1);
+                StoreVector<IsStream>(&transforms[2][row][0], c2);
+                StoreVector<IsStream>(&transforms[3][row][0], c3);
+            }
+        }
+#endif
+    }
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    namespace Detail {
+        template<bool IsStream, typename Transform>
+        size_t ComposeTRSWide(const glm::vec3* __restrict scales, const glm::quat* __restrict rotations, const glm::vec3* __restrict translations,
+                              Transform* __restrict transforms, size_t count) noexcept {
+            size_t i = 0;
+            for (; i + Width <= count; i += Width) {
+                glm_vec4 matrix[3][4];
+                ComposeTRS(scales + i, rotations + i, translations + i, matrix);
+                Store<IsStream>(matrix, transforms + i);
+            }
+            if constexpr (IsStream) {
+                _mm_sfence();
+            }
+            return i;
+        }
+    }
+#endif
+
+    // Output is glm::mat4 or Affine.
+    template<StoreHint Hint = StoreHint::Cached, typename Transform>
+    void ComposeTRS(const glm::vec3* __restrict scales, const glm::quat* __restrict rotations, const glm::vec3* __restrict translations,
+                    Transform* __restrict transforms, size_t count) noexcept {
+        static_assert(0 == sizeof(Transform) % 16, "Every row of an aligned column must stay aligned.");
+
+        size_t i = 0;
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        if (StoreHint::Stream == Hint && 0 == (reinterpret_cast<uintptr_t>(transforms) & 15)) {
+            i = Detail::ComposeTRSWide<true>(scales, rotations, translations, transforms, count);
+        }
+        else {
+            i = Detail::ComposeTRSWide<false>(scales, rotations, translations, transforms, count);
+        }
+#endif
+        for (; i < count; ++i) {
+            Detail::ComposeTRS(scales[i], rotations[i], translations[i], transforms[i]);
+        }
+    }
+
+    [[nodiscard]] __inline glm::mat4 ToMat4(const Affine& affine) noexcept {
+        return glm::mat4{ glm::transpose(affine) };
+    }
+
+    //=================================================================================================================
+    // Rotate
+    // rotations[i] = rotations[i] * delta, the same as glm::rotate(rotation, angle, axis) with delta built once by
+    // glm::angleAxis, so no sin/cos is left per entity. On SSE each product is four broadcast multiply-adds
+    // against the columns of delta's product matrix, no transposes. Repeated products drift off unit length;
+    // Normalize is the pass to run every so many frames.
+    //=================================================================================================================
+    namespace Detail {
+#ifdef GLM_FORCE_QUAT_DATA_XYZW
+        constexpr int LaneW = 3, LaneX = 0, LaneY = 1, LaneZ = 2;
+#else
+        constexpr int LaneW = 0, LaneX = 1, LaneY = 2, LaneZ = 3;
+#endif
+    }
+
+    __inline void Rotate(glm::quat* __restrict rotations, size_t count, const glm::quat& delta) noexcept {
+        size_t i = 0;
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        // q * d = q.w * bw + q.x * bx + q.y * by + q.z * bz, the b in quaternion storage order.
+        const glm::quat bw{ delta.w, glm::vec3{ delta.x, delta.y, delta.z } };
+        const glm::quat bx{ -delta.x, glm::vec3{ delta.w, -delta.z, delta.y } };
+        const glm::quat by{ -delta.y, glm::vec3{ delta.z, delta.w, -delta.x } };
+        const glm::quat bz{ -delta.z, glm::vec3{ -delta.y, delta.x, delta.w } };
+        const auto cw = _mm_loadu_ps(&bw[0]), cx = _mm_loadu_ps(&bx[0]), cy = _mm_loadu_ps(&by[0]), cz = _mm_loadu_ps(&bz[0]);
+
+        for (; i < count; ++i) {
+            auto* rotation = &rotations[i][0];
+            const auto q = _mm_loadu_ps(rotation);
+            auto result = _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(Detail::LaneW, Detail::LaneW, Detail::LaneW, Detail::LaneW)), cw);
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(Detail::LaneX, Detail::LaneX, Detail::LaneX, Detail::LaneX)), cx));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(Detail::LaneY, Detail::LaneY, Detail::LaneY, Detail::LaneY)), cy));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(Detail::LaneZ, Detail::LaneZ, Detail::LaneZ, Detail::LaneZ)), cz));
+            _mm_storeu_ps(rotation, result);
+        }
+#endif
+        for (; i < count; ++i) {
+            rotations[i] = rotations[i] * delta;
+        }
+    }
+
+    __inline void Normalize(glm::quat* __restrict rotations, size_t count) noexcept {
+        size_t i = 0;
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        for (; i < count; ++i) {
+            auto* rotation = &rotations[i][0];
+            const auto q = _mm_loadu_ps(rotation);
+            auto dot = _mm_mul_ps(q, q);
+            dot = _mm_add_ps(dot, _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(2, 3, 0, 1)));
+            dot = _mm_add_ps(dot, _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(1, 0, 3, 2)));
+            _mm_storeu_ps(rotation, _mm_div_ps(q, _mm_sqrt_ps(dot)));
+        }
+#endif
+        for (; i < count; ++i) {
+            rotations[i] = glm::normalize(rotations[i]);
+        }
+    }
+}
@@ -0,0 +1,157 @@
+// Copyright 2011-2021 GameParadiso, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <glm/gtc/packing.hpp>
+
+namespace Math::Packing {
+    //=================================================================================================================
+    // Packed storage types
+    // Opt-in component encodings that trade precision for bytes per entity, so a chunk holds more rows and a
+    // memory bound system streams fewer bytes. Systems unpack a run into a scratch buffer, work on floats and
+    // pack the run back; the batch forms below are the accessors for that.
+    //=================================================================================================================
+
+    // Smallest three : the largest component is dropped and rebuilt from unit length, its sign folded in by
+    // negating the quaternion. 2 bits index + 3 x 20 bits, 8 bytes instead of 16, error around 2e-6.
+    struct Quat {
+        uint64_t bits = 0;
+    };
+
+    // IEEE half per component, 6 bytes instead of 12. Good for scales and directions, not for world positions.
+    struct HalfVec3 {
+        uint16_t x = 0, y = 0, z = 0;
+    };
+
+    // Offset from a frame origin in steps of frame.step, 6 bytes instead of 12. int16 covers +-32767 steps, so the
+    // frame is usually a chunk component holding the center of the chunk's entities.
+    struct FixedVec3 {
+        int16_t x = 0, y = 0, z = 0;
+    };
+    struct FixedFrame {
+        glm::vec3 origin{ 0.0f };
+        float     step = 1.0f / 256.0f;
+    };
+
+    namespace Detail {
+        constexpr uint32_t QuatComponentBits = 20;
+        constexpr uint32_t QuatComponentMax  = (1u << QuatComponentBits) - 1;
+        constexpr float    QuatRange         = 0.70710678f; // 1 / sqrt(2), the most any of the three smaller can be
+        // The three kept components in x, y, z, w order, by the dropped one.
+        constexpr uint32_t QuatOthers[4][3]  = { { 1, 2, 3 }, { 0, 2, 3 }, { 0, 1, 3 }, { 0, 1, 2 } };
+
+        [[nodiscard]] __inline uint64_t PackQuatComponent(float value) noexcept {
+            const auto unit = glm::clamp(value / QuatRange * 0.5f + 0.5f, 0.0f, 1.0f);
+            return static_cast<uint64_t>(unit * QuatComponentMax + 0.5f);
+        }
+
+        [[nodiscard]] __inline float UnpackQuatComponent(uint64_t bits) noexcept {
+            const auto unit = static_cast<float>(bits & QuatComponentMax) * (1.0f / QuatComponentMax);
+            return (unit * 2.0f - 1.0f) * QuatRange;
+        }
+    }
+
+    [[nodiscard]] __inline Quat PackQuat(const glm::quat& rotation) noexcept {
+        const float components[4]{ rotation.x, rotation.y, rotation.z, rotation.w };
+
+        uint32_t largest = 0;
+        for (uint32_t i = 1; i < 4; ++i) {
+            largest = std::abs(components[i]) > std::abs(components[largest]) ? i : largest;
+        }
+        const auto sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+        const auto& others = Detail::QuatOthers[largest];
+
+        return { largest
+               | Detail::PackQuatComponent(components[others[0]] * sign) << 2
+               | Detail::PackQuatComponent(components[others[1]] * sign) << (2 + Detail::QuatComponentBits)
+               | Detail::PackQuatComponent(components[others[2]] * sign) << (2 + Detail::QuatComponentBits * 2) };
+    }
+
+    [[nodiscard]] __inline glm::quat UnpackQuat(Quat packed) noexcept {
+        const auto& others = Detail::QuatOthers[packed.bits & 0x3];
+        const auto a = Detail::UnpackQuatComponent(packed.bits >> 2);
+        const auto b = Detail::UnpackQuatComponent(packed.bits >> (2 + Detail::QuatComponentBits));
+        const auto c = Detail::UnpackQuatComponent(packed.bits >> (2 + Detail::QuatComponentBits * 2));
+
+        float components[4];
+        components[packed.bits & 0x3] = std::sqrt(std::max(0.0f, 1.0f - (a * a + b * b + c * c)));
+        components[others[0]] = a;
+        components[others[1]] = b;
+        components[others[2]] = c;
+
+        return glm::quat{ components[3], glm::vec3{ components[0], components[1], components[2] } };
+    }
+
+    [[nodiscard]] __inline HalfVec3 PackHalf(const glm::vec3& value) noexcept {
+        return { glm::packHalf1x16(value.x), glm::packHalf1x16(value.y), glm::packHalf1x16(value.z) };
+    }
+
+    [[nodiscard]] __inline glm::vec3 UnpackHalf(HalfVec3 packed) noexcept {
+        return { glm::unpackHalf1x16(packed.x), glm::unpackHalf1x16(packed.y), glm::unpackHalf1x16(packed.z) };
+    }
+
+    [[nodiscard]] __inline FixedVec3 PackFixed(const glm::vec3& value, const FixedFrame& frame) noexcept {
+        const auto steps = glm::clamp(glm::round((value - frame.origin) / frame.step), glm::vec3{ -32767.0f }, glm::vec3{ 32767.0f });
+        return { static_cast<int16_t>(steps.x), static_cast<int16_t>(steps.y), static_cast<int16_t>(steps.z) };
+    }
+
+    [[nodiscard]] __inline glm::vec3 UnpackFixed(FixedVec3 packed, const FixedFrame& frame) noexcept {
+        return frame.origin + glm::vec3{ packed.x, packed.y, packed.z } * frame.step;
+    }
+
+    //=================================================================================================================
+    // Batch accessors
+    // Whole runs at once. Half conversion uses F16C when the build targets AVX2 (round to nearest, it may differ
+    // from glm's scalar packing in the last bit), the rest are plain loops the compiler is free to vectorize.
+    //=================================================================================================================
+    __inline void Pack(const glm::quat* __restrict source, Quat* __restrict dest, size_t count) noexcept {
+        for (size_t i = 0; i < count; ++i) {
+            dest[i] = PackQuat(source[i]);
+        }
+    }
+
+    __inline void Unpack(const Quat* __restrict source, glm::quat* __restrict dest, size_t count) noexcept {
+        for (size_t i = 0; i < count; ++i) {
+            dest[i] = UnpackQuat(source[i]);
+        }
+    }
+
+    __inline void Pack(const glm::vec3* __restrict source, HalfVec3* __restrict dest, size_t count) noexcept {
+        size_t i = 0;
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+        // Four lanes converted, three of them kept.
+        for (; i + 1 < count; ++i) {
+            const auto halves = _mm_cvtps_ph(_mm_loadu_ps(&source[i].x), _MM_FROUND_TO_NEAREST_INT);
+            std::memcpy(&dest[i], &halves, sizeof(HalfVec3));
+        }
+#endif
+        for (; i < count; ++i) {
+            dest[i] = PackHalf(source[i]);
+        }
+    }
+
+    __inline void Unpack(const HalfVec3* __restrict source, glm::vec3* __restrict dest, size_t count) noexcept {
+        size_t i = 0;
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+        for (; i + 1 < count; ++i) {
+            const auto floats = _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&source[i])));
+            std::memcpy(&dest[i], &floats, sizeof(glm::vec3));
+        }
+#endif
+        for (; i < count; ++i) {
+            dest[i] = UnpackHalf(source[i]);
+        }
+    }
+
+    __inline void Pack(const glm::vec3* __restrict source, FixedVec3* __restrict dest, size_t count, const FixedFrame& frame) noexcept {
+        for (size_t i = 0; i < count; ++i) {
+            dest[i] = PackFixed(source[i], frame);
+        }
+    }
+
+    __inline void Unpack(const FixedVec3* __restrict source, glm::vec3* __restrict dest, size_t count, const FixedFrame& frame) noexcept {
+        for (size_t i = 0; i < count; ++i) {
+            dest[i] = UnpackFixed(source[i], frame);
+        }
+    }
+}
@@ -5,6 +5,8 @@
 
 #include "Scenario001.h"
 #include "Scenario002.h"
+#include "Scenario003.h"
+#include "Scenario004.h"
 
 namespace Scenario {
     template<typename T>
@@ -13,7 +15,7 @@ namespace Scenario {
     }
 
     std::vector<uint32_t> GetIndices() {
-        return { 1, 2 };
+        return { 1, 2, 3, 4 };
     }
 
     bool Run(uint32_t index) {
@@ -24,6 +26,12 @@ namespace Scenario {
         case 2:
             Generate<ScenarioChunkECS>();
             break;
+        case 3:
+            Generate<ScenarioRandomAccessECS>();
+            break;
+        case 4:
+            Generate<ScenarioHierarchyECS>();
+            break;
         default:
             return false;
         }
@@ -3,7 +3,10 @@
 #include <pch.h>
 #include "Scenario002.h"
 
-#include "ECS/System.h"
+#include "ECS/World.h"
+#include "ECS/Expiry.h"
+#include "MathmaticsBatch.h"
+#include "MathmaticsPacking.h"
 
 namespace {
     struct ScaleComponent {
@@ -18,9 +21,19 @@ namespace {
     struct TransformComponent {
         glm::mat4 value;
     };
+    // Time of death on the timer, handed to the expiry wheel on creation. Nothing writes it afterwards, so chunk
+    // aggregates of it stay cached.
     struct LifeComponent {
         float value;
     };
+    using LifeRange = ECS::MinMax<LifeComponent, &LifeComponent::value>;
+    // Rotation kept as smallest three, 8 bytes instead of 16.
+    struct PackedRotationComponent {
+        Math::Packing::Quat value;
+    };
+
+    // Spinners living for the whole run, rotated through the packed encoding.
+    constexpr uint32_t NumPackedEntities = 4096;
 
     namespace ArchType {
         [[nodiscard]] constexpr ECS::Hashes GetHashes() noexcept {
@@ -43,11 +56,29 @@ namespace {
         }
     };
 
+    namespace PackedArchType {
+        [[nodiscard]] ECS::Hashes GetHashes() noexcept {
+            return {
+                typeid(PackedRotationComponent).hash_code(),
+            };
+        }
+        [[nodiscard]] ECS::HashSizePairs GetHashSizePairs() noexcept {
+            return {
+                { typeid(PackedRotationComponent).hash_code(), static_cast<ECS::Size>(sizeof(PackedRotationComponent)) },
+            };
+        }
+    };
+
     class PrintScreenSystem final : public ECS::System {
     public:
-        explicit PrintScreenSystem(const Util::Timer& timer, float interval)
+        explicit PrintScreenSystem(ECS::Engine& ecsEngine, const Util::Timer& timer, float interval)
             : ECS::System({})
+            , _dyingQuery(ecsEngine)
             , _timer(timer), _interval(interval) {
+            // Chunks whose earliest death is further ahead than the window are skipped without reading a single row.
+            _dyingQuery.WhereChunk<LifeRange>([this](const LifeRange& range)->bool {
+                return range.min <= _timer.Total() + DyingWindowSeconds;
+            });
         }
 
         void Run(ECS::Engine& ecsEngine, float delta) override {
@@ -65,20 +96,38 @@ namespace {
             fmt::print("Total time         : {}\n", _timer.Total());
             fmt::print("FPS                : {}\n", _timer.Frame());
             fmt::print("Ratio FPS          : {}\n", _ratioFrame);
+            fmt::print("Dying within 1s    : {}\n", CountDying());
         }
 
     private:
-        const Util::Timer& _timer;
-        const float        _interval;
-        float              _checkTime = 0.0f;
-        uint32_t           _ratioFrame = 0;
+        static constexpr float DyingWindowSeconds = 1.0f;
+
+        [[nodiscard]] size_t CountDying() {
+            const auto until = _timer.Total() + DyingWindowSeconds;
+            size_t result = 0;
+            _dyingQuery.EachChunk([until, &result](const ECS::QueryChunk&, std::span<const LifeComponent> lifeCycles) {
+                result += std::ranges::count_if(lifeCycles, [until](const auto& lifeCycle) { return lifeCycle.value <= until; });
+            });
+            return result;
+        }
+
+        ECS::Query<const LifeComponent> _dyingQuery;
+        const Util::Timer&              _timer;
+        const float                     _interval;
+        float                           _checkTime = 0.0f;
+        uint32_t                        _ratioFrame = 0;
     };
 
     class CreateEntitySystem final : public ECS::System {
     public:
-        explicit CreateEntitySystem(uint32_t maxCount, float minLifeSeconds, float maxLifeSeconds)
+        explicit CreateEntitySystem(ECS::Engine& ecsEngine, ECS::Expiry& expiry, const Util::Timer& timer, uint32_t maxCount, float minLifeSeconds, float maxLifeSeconds)
             : ECS::System(ArchType::GetHashes())
-            , _maxCount(maxCount), _minLifeSeconds(minLifeSeconds), _maxLifeSeconds(maxLifeSeconds) {
+            , _prefab(ecsEngine.CreatePrefab(_hashes))
+            , _expiry(expiry), _timer(timer), _maxCount(maxCount), _minLifeSeconds(minLifeSeconds), _maxLifeSeconds(maxLifeSeconds) {
+            _prefab->Accept<ScaleComponent>()->value = Math::Vec3::One;
+            _prefab->Accept<RotationComponent>()->value = Math::Quat::Identity;
+            _prefab->Accept<TranslateComponent>()->value = Math::Vec3::Zero;
+            _prefab->Accept<TransformComponent>()->value = Math::Mat4::Identity;
         }
 
         void Run(ECS::Engine& ecsEngine, float delta) override {
@@ -87,80 +136,117 @@ namespace {
 
     protected:
         void CreateEntities(ECS::Engine& ecsEngine) const {
-            for (auto i = static_cast<decltype(_maxCount)>(ecsEngine.GetNumTotalEntity()); i < _maxCount; ++i) {
-                const auto& [scale, rotation, translation, transform, lifeCycle] =
-                    Chunk::Accept<ScaleComponent, RotationComponent, TranslateComponent, TransformComponent, LifeComponent>(ecsEngine.CreateEntity(_hashes)->Get(_hashes));
-
-                scale->value = Math::Vec3::One;
-                rotation->value = Math::Quat::Identity;
-                translation->value = Math::Vec3::Zero;
-                transform->value = Math::Mat4::Identity;
-                lifeCycle->value = Util::Random::Distribution(_minLifeSeconds, _maxLifeSeconds);
+            const auto numEntities = ecsEngine.GetNumTotalEntity();
+            if (numEntities >= _maxCount) {
+                return;
+            }
+
+            const auto runs = ecsEngine.Instantiate<LifeComponent>(*_prefab, _maxCount - numEntities, [this, now = _timer.Total()](size_t, LifeComponent& lifeCycle) {
+                lifeCycle.value = now + Util::Random::Distribution(_minLifeSeconds, _maxLifeSeconds);
+            });
+
+            for (const auto& entities : runs) {
+                const auto* lifeCycles = ecsEngine.Accept<LifeComponent>(entities.front(), typeid(LifeComponent).hash_code());
+                for (size_t i = 0; i < entities.size(); ++i) {
+                    _expiry.Schedule(entities[i], lifeCycles[i].value);
+                }
             }
         }
 
     private:
-        const uint32_t _maxCount;
-        const float    _minLifeSeconds;
-        const float    _maxLifeSeconds;
+        std::optional<ECS::Prefab> _prefab;
+        ECS::Expiry&               _expiry;
+        const Util::Timer&         _timer;
+        const uint32_t             _maxCount;
+        const float                _minLifeSeconds;
+        const float                _maxLifeSeconds;
     };
 
     class DestroyEntitySystem final : public ECS::System {
     public:
-        explicit DestroyEntitySystem(ECS::Engine& ecsEngine)
-            : ECS::System({ typeid(LifeComponent).hash_code() })
-            , _ecsEngine(ecsEngine) {
+        explicit DestroyEntitySystem(ECS::Expiry& expiry, const Util::Timer& timer)
+            : ECS::System({})
+            , _expiry(expiry)
+            , _timer(timer) {
         }
 
-    protected:
-        void ForEach(ECS::Engine&, const ECS::Collector& collector, float delta) override {
-            auto* lifeCycles = Accept<LifeComponent>(collector);
+        void Run(ECS::Engine& ecsEngine, float) override {
+            (void)_expiry.Update(ecsEngine, _timer.Total());
+        }
 
-            for(std::remove_const_t<decltype(collector.count)> i = 0; i < collector.count; ++i) {
-                lifeCycles[i].value -= delta;
-                if (0.0f >= lifeCycles[i].value) {
-                    _ecsEngine.DestroyEntity(collector.handler, i);
-                }
+    private:
+        ECS::Expiry&       _expiry;
+        const Util::Timer& _timer;
+    };
+
+    class RotationSystem final : public ECS::StaticSystem<RotationSystem, RotationComponent> {
+        static constexpr uint32_t NormalizeInterval = 64;
+
+    public:
+        static void Configure(QueryType& query) {
+            query.Prefetch<RotationComponent>();
+        }
+
+        // The frame's rotation is the same for every entity, so it is built once here instead of per entity.
+        void BeginFrame(float delta) {
+            _delta = glm::angleAxis(delta, Math::Vec3::AxisY);
+            _isNormalize = 0 == ++_frame % NormalizeInterval;
+        }
+
+        __inline void ForEachChunk(const ECS::QueryChunk& chunk, float, RotationComponent* __restrict rotations) const {
+            static_assert(sizeof(RotationComponent) == sizeof(glm::quat), "Components must wrap the math types.");
+
+            Math::Batch::Rotate(&rotations->value, chunk.entities.size(), _delta);
+            if (_isNormalize) {
+                Math::Batch::Normalize(&rotations->value, chunk.entities.size());
             }
         }
 
     private:
-        ECS::Engine& _ecsEngine;
+        glm::quat _delta = Math::Quat::Identity;
+        uint32_t  _frame = 0;
+        bool      _isNormalize = false;
     };
 
-    class RotationSystem final : public ECS::System {
+    class PackedRotationSystem final : public ECS::StaticSystem<PackedRotationSystem, PackedRotationComponent> {
     public:
-        RotationSystem() : ECS::System({ typeid(RotationComponent).hash_code() }) {
+        void BeginFrame(float delta) {
+            _delta = glm::angleAxis(delta, Math::Vec3::AxisY);
         }
 
-        void ForEach(ECS::Engine&, const ECS::Collector& collector, float delta) override {
-            auto* rotations = Accept<RotationComponent>(collector);
-            for(std::remove_const_t<decltype(collector.count)> i = 0; i < collector.count; ++i) {
-                rotations[i].value = glm::rotate(rotations[i].value, delta, Math::Vec3::AxisY);
-            }
+        // A run is unpacked to scratch floats, rotated by the batch kernel and packed back. Unpacking rebuilds the
+        // dropped component from unit length, so no Normalize pass is needed.
+        __inline void ForEachChunk(const ECS::QueryChunk& chunk, float, PackedRotationComponent* __restrict rotations) {
+            static_assert(sizeof(PackedRotationComponent) == sizeof(Math::Packing::Quat), "Components must wrap the packed types.");
+
+            const auto count = chunk.entities.size();
+            _scratch.resize(count);
+            Math::Packing::Unpack(&rotations->value, _scratch.data(), count);
+            Math::Batch::Rotate(_scratch.data(), count, _delta);
+            Math::Packing::Pack(_scratch.data(), &rotations->value, count);
         }
+
+    private:
+        glm::quat              _delta = Math::Quat::Identity;
+        std::vector<glm::quat> _scratch;
     };
 
-    class TransformSystem final : public ECS::System {
+    class TransformSystem final : public ECS::StaticSystem<TransformSystem, const ScaleComponent, const RotationComponent, const TranslateComponent, TransformComponent> {
     public:
-        TransformSystem() : ECS::System({
-            typeid(ScaleComponent).hash_code(),
-            typeid(RotationComponent).hash_code(),
-            typeid(TranslateComponent).hash_code(),
-            typeid(TransformComponent).hash_code(),
-        }) {
-        }
-
-        void ForEach(ECS::Engine&, const ECS::Collector& collector, float delta) override {
-            const auto& [scales, rotations, translations, transforms] = 
-                Accept<ScaleComponent, RotationComponent, TranslateComponent, TransformComponent>(collector);
-
-            for(std::remove_const_t<decltype(collector.count)> i = 0; i < collector.count; ++i) {
-                const auto scaleTm = glm::scale(Math::Mat4::Identity, scales[i].value);
-                const auto rotationTm = glm::toMat4(rotations[i].value);
-                const auto posTm = glm::translate(Math::Mat4::Identity, translations[i].value);
-                transforms[i].value = posTm * rotationTm * scaleTm;
-            }
+        static void Configure(QueryType& query) {
+            query.Changed<ScaleComponent>().Changed<RotationComponent>().Changed<TranslateComponent>()
+                 .Prefetch<ScaleComponent, RotationComponent, TranslateComponent>();
+        }
+
+        // Each run of rows goes through the batch kernel in one call instead of per entity. Transforms aren't read
+        // again this frame, but streaming them measured slower at this entity count, so StreamTypes stays empty.
+        __inline void ForEachChunk(const ECS::QueryChunk& chunk, float, const ScaleComponent* __restrict scales, const RotationComponent* __restrict rotations,
+                                   const TranslateComponent* __restrict translations, TransformComponent* __restrict transforms) const {
+            static_assert(sizeof(ScaleComponent) == sizeof(glm::vec3) && sizeof(RotationComponent) == sizeof(glm::quat)
+                       && sizeof(TranslateComponent) == sizeof(glm::vec3) && sizeof(TransformComponent) == sizeof(glm::mat4), "Components must wrap the math types.");
+
+            constexpr auto Hint = IsStreamed<TransformComponent>() ? Math::Batch::StoreHint::Stream : Math::Batch::StoreHint::Cached;
+            Math::Batch::ComposeTRS<Hint>(&scales->value, &rotations->value, &translations->value, &transforms->value, chunk.entities.size());
         }
     };
 }
@@ -170,23 +256,31 @@ namespace Scenario {
         fmt::print("Start chunk ecs scenario.\n");
 
         ECS::Engine ecsEngine;
-        ecsEngine.RegistryTypeInformation(ArchType::GetHashSizePairs()); {
+        ecsEngine.RegistryTypeInformation(ArchType::GetHashSizePairs());
+        ecsEngine.RegistryTypeInformation(PackedArchType::GetHashSizePairs()); {
             Util::Timer timer;
 
-            PrintScreenSystem printScreenSystem(timer, 1.0f);
-            CreateEntitySystem createSystem(NumEntities, 1.0f, 10.0f);
-            DestroyEntitySystem destroySystem(ecsEngine);
+            auto packedPrefab = ecsEngine.CreatePrefab(PackedArchType::GetHashes());
+            packedPrefab->Accept<PackedRotationComponent>()->value = Math::Packing::PackQuat(Math::Quat::Identity);
+            (void)ecsEngine.Instantiate(*packedPrefab, NumPackedEntities);
+
+            PrintScreenSystem printScreenSystem(ecsEngine, timer, 1.0f);
+            ECS::Expiry expiry;
+
+            // The packed spinners count in the engine's total.
+            CreateEntitySystem createSystem(ecsEngine, expiry, timer, NumEntities + NumPackedEntities, 1.0f, 10.0f);
+            DestroyEntitySystem destroySystem(expiry, timer);
             RotationSystem rotationSystem;
+            PackedRotationSystem packedRotationSystem;
             TransformSystem transformSystem;
+            // Both cover the one archetype, so each chunk is rotated and composed while it is in cache.
+            ECS::Fused transformPass(rotationSystem, transformSystem);
+
+            ECS::World world(ecsEngine, printScreenSystem, createSystem, destroySystem, transformPass, packedRotationSystem);
 
             while(60.0f > timer.Total()) {
                 timer.Update();
-
-                printScreenSystem.Run(ecsEngine, timer.Delta());
-                createSystem.Run(ecsEngine, timer.Delta());
-                destroySystem.Run(ecsEngine, timer.Delta());
-                rotationSystem.Run(ecsEngine, timer.Delta());
-                transformSystem.Run(ecsEngine, timer.Delta());
+                world.Run(timer.Delta());
             }
         }
     }
@@ -0,0 +1,223 @@
+// Copyright 2011-2021 GameParadiso, Inc. All Rights Reserved.
+
+#include <pch.h>
+#include "Scenario003.h"
+
+#include "ECS/System.h"
+#include "ECS/ComponentLookup.h"
+
+namespace {
+    struct TranslateComponent {
+        glm::vec3 value;
+    };
+    struct VelocityComponent {
+        glm::vec3 value;
+    };
+    struct TargetComponent {
+        ECS::Entity value;
+    };
+
+    namespace ArchType {
+        [[nodiscard]] ECS::Hashes GetHashes() noexcept {
+            return {
+                typeid(TranslateComponent).hash_code(),
+                typeid(VelocityComponent).hash_code(),
+                typeid(TargetComponent).hash_code(),
+            };
+        }
+        [[nodiscard]] ECS::HashSizePairs GetHashSizePairs() noexcept {
+            return {
+                { typeid(TranslateComponent).hash_code(), static_cast<ECS::Size>(sizeof(TranslateComponent)) },
+                { typeid(VelocityComponent).hash_code(), static_cast<ECS::Size>(sizeof(VelocityComponent)) },
+                { typeid(TargetComponent).hash_code(), static_cast<ECS::Size>(sizeof(TargetComponent)) },
+            };
+        }
+    };
+
+    //=================================================================================================================
+    // ProfileSystem : accumulates the time spent in Run, so the access patterns can be compared side by side.
+    //=================================================================================================================
+    class ProfileSystem : public ECS::System {
+        using Clock = std::chrono::high_resolution_clock;
+
+    public:
+        explicit ProfileSystem(ECS::Hashes&& hashes) : ECS::System(std::move(hashes)) {
+        }
+
+        void Run(ECS::Engine& ecsEngine, float delta) override {
+            const auto start = Clock::now();
+            ECS::System::Run(ecsEngine, delta);
+            _elapsed += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+            ++_frame;
+        }
+
+        [[nodiscard]] uint64_t PopAverageMicroseconds() noexcept {
+            const auto result = 0 == _frame ? 0 : _elapsed / _frame;
+            _elapsed = _frame = 0;
+            return result;
+        }
+
+    private:
+        uint64_t _elapsed = 0;
+        uint64_t _frame = 0;
+    };
+
+    class PrintScreenSystem final : public ECS::System {
+    public:
+        explicit PrintScreenSystem(const Util::Timer& timer, float interval, ProfileSystem& linear, ProfileSystem& lookup, ProfileSystem& hashLookup)
+            : ECS::System({})
+            , _timer(timer), _interval(interval)
+            , _linear(linear), _lookup(lookup), _hashLookup(hashLookup) {
+        }
+
+        void Run(ECS::Engine& ecsEngine, float delta) override {
+            _checkTime -= delta;
+            if(0.0f < _checkTime) {
+                return;
+            }
+            _checkTime += _interval;
+
+            system("cls");
+
+            fmt::print("Total entity count  : {}\n", ecsEngine.GetNumTotalEntity());
+            fmt::print("Total time          : {}\n", _timer.Total());
+            fmt::print("FPS                 : {}\n", _timer.Frame());
+            fmt::print("Linear chunk (us)   : {}\n", _linear.PopAverageMicroseconds());
+            fmt::print("Lookup follow (us)  : {}\n", _lookup.PopAverageMicroseconds());
+            fmt::print("Hash follow (us)    : {}\n", _hashLookup.PopAverageMicroseconds());
+        }
+
+    private:
+        const Util::Timer& _timer;
+        const float        _interval;
+        float              _checkTime = 0.0f;
+        ProfileSystem&     _linear;
+        ProfileSystem&     _lookup;
+        ProfileSystem&     _hashLookup;
+    };
+
+    void CreateEntities(ECS::Engine& ecsEngine, uint32_t count) {
+        const auto hashes = ArchType::GetHashes();
+
+        ECS::Entities entities;
+        entities.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto entity = ecsEngine.CreateEntity(hashes);
+
+            ecsEngine.Accept<TranslateComponent>(entity, hashes[0])->value = glm::vec3{
+                Util::Random::Distribution(0.0f, 1000.0f),
+                Util::Random::Distribution(0.0f, 1000.0f),
+                Util::Random::Distribution(0.0f, 1000.0f) };
+            ecsEngine.Accept<VelocityComponent>(entity, hashes[1])->value = Math::Vec3::Zero;
+            entities.emplace_back(entity);
+        }
+
+        // Random targets, so following them jumps across chunks instead of walking them.
+        for (const auto entity : entities) {
+            auto* target = ecsEngine.Accept<TargetComponent>(entity, hashes[2]);
+            target->value = entities[Util::Random::Distribution(0u, count - 1)];
+        }
+    }
+
+    class MoveSystem final : public ProfileSystem {
+    public:
+        MoveSystem() : ProfileSystem({
+            typeid(TranslateComponent).hash_code(),
+            typeid(VelocityComponent).hash_code(),
+        }) {
+        }
+
+    protected:
+        void ForEach(ECS::Engine&, const ECS::Collector& collector, float delta) override {
+            const auto& [translations, velocities] = Accept<TranslateComponent, VelocityComponent>(collector);
+
+            for(std::remove_const_t<decltype(collector.count)> i = 0; i < collector.count; ++i) {
+                translations[i].value += velocities[i].value * delta;
+            }
+        }
+    };
+
+    class FollowLookupSystem final : public ProfileSystem {
+    public:
+        FollowLookupSystem() : ProfileSystem({
+            typeid(VelocityComponent).hash_code(),
+            typeid(TargetComponent).hash_code(),
+            typeid(TranslateComponent).hash_code(),
+        }) {
+        }
+
+        void Run(ECS::Engine& ecsEngine, float delta) override {
+            _translations.emplace(ecsEngine);
+            ProfileSystem::Run(ecsEngine, delta);
+        }
+
+    protected:
+        void ForEach(ECS::Engine&, const ECS::Collector& collector, float) override {
+            const auto& [velocities, targets, translations] = Accept<VelocityComponent, TargetComponent, const TranslateComponent>(collector);
+
+            for(std::remove_const_t<decltype(collector.count)> i = 0; i < collector.count; ++i) {
+                if (const auto* targetTranslation = _translations->Get(targets[i].value);
+                    nullptr != targetTranslation) {
+                    velocities[i].value = targetTranslation->value - translations[i].value;
+                }
+            }
+        }
+
+    private:
+        std::optional<ECS::ComponentLookup<const TranslateComponent>> _translations;
+    };
+
+    class FollowHashSystem final : public ProfileSystem {
+    public:
+        FollowHashSystem() : ProfileSystem({
+            typeid(VelocityComponent).hash_code(),
+            typeid(TargetComponent).hash_code(),
+            typeid(TranslateComponent).hash_code(),
+        }) {
+        }
+
+    protected:
+        void ForEach(ECS::Engine& ecsEngine, const ECS::Collector& collector, float) override {
+            const auto& [velocities, targets, translations] = Accept<VelocityComponent, TargetComponent, const TranslateComponent>(collector);
+
+            for(std::remove_const_t<decltype(collector.count)> i = 0; i < collector.count; ++i) {
+                if (const auto* targetTranslation = ecsEngine.Accept<const TranslateComponent>(targets[i].value, typeid(TranslateComponent).hash_code());
+                    nullptr != targetTranslation) {
+                    velocities[i].value = targetTranslation->value - translations[i].value;
+                }
+            }
+        }
+    };
+}
+
+namespace Scenario {
+    ScenarioRandomAccessECS::ScenarioRandomAccessECS() {
+        fmt::print("Start random access ecs scenario.\n");
+
+        ECS::Engine ecsEngine;
+        ecsEngine.RegistryTypeInformation(ArchType::GetHashSizePairs());
+        CreateEntities(ecsEngine, NumEntities); {
+            Util::Timer timer;
+
+            MoveSystem moveSystem;
+            FollowLookupSystem followLookupSystem;
+            FollowHashSystem followHashSystem;
+            PrintScreenSystem printScreenSystem(timer, 1.0f, moveSystem, followLookupSystem, followHashSystem);
+
+            while(60.0f > timer.Total()) {
+                timer.Update();
+
+                printScreenSystem.Run(ecsEngine, timer.Delta());
+                followHashSystem.Run(ecsEngine, timer.Delta());
+                followLookupSystem.Run(ecsEngine, timer.Delta());
+                moveSystem.Run(ecsEngine, timer.Delta());
+            }
+        }
+    }
+
+    ScenarioRandomAccessECS::~ScenarioRandomAccessECS() {
+        fmt::print("End random access ecs scenario.\n");
+        fmt::print("Press any key to end...\n");
+        (void)_getch();
+    }
+}
@@ -0,0 +1,13 @@
+// Copyright 2011-2021 GameParadiso, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Scenario000.h"
+
+namespace Scenario {
+    class ScenarioRandomAccessECS final : public Scenario {
+    public:
+        ScenarioRandomAccessECS();
+        ~ScenarioRandomAccessECS() override;
+    };
+}
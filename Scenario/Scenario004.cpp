@@ -0,0 +1,294 @@
+// Copyright 2011-2021 GameParadiso, Inc. All Rights Reserved.
+
+#include <pch.h>
+#include "Scenario004.h"
+
+#include "ECS/World.h"
+#include "ECS/Hierarchy.h"
+#include "ECS/Snapshot.h"
+
+namespace {
+    // Roots carrying it spin, so only their subtrees are dirty each frame.
+    struct SpinTag {
+    };
+
+    constexpr uint32_t NumChildren = 7;
+    constexpr uint32_t NumLevels = 3;
+    constexpr uint32_t SpinInterval = 8;
+
+    namespace ArchType {
+        [[nodiscard]] ECS::HashSizePairs GetHashSizePairs(bool isSpin) {
+            auto result = ECS::TransformHierarchy::GetHashSizePairs();
+            if (isSpin) {
+                result.emplace_back(ECS::TypeHashSize<SpinTag>());
+            }
+            return result;
+        }
+        [[nodiscard]] ECS::Hashes GetHashes(bool isSpin) {
+            auto result = ECS::TransformHierarchy::GetHashes();
+            if (isSpin) {
+                result.emplace_back(ECS::TypeHash<SpinTag>());
+            }
+            return result;
+        }
+    };
+
+    //=================================================================================================================
+    // ExtractSystem : publishes LocalToWorld at the end of the frame. A thread of its own reads the published frame
+    // while the next one is simulated, the way a renderer extracts.
+    //=================================================================================================================
+    class ExtractSystem final {
+    public:
+        explicit ExtractSystem(ECS::Engine& ecsEngine) : _snapshot(ecsEngine), _thread([this](std::stop_token stop) { Extract(stop); }) {
+        }
+
+        void Run(ECS::Engine&, float) {
+            _snapshot.Publish();
+        }
+
+        [[nodiscard]] std::shared_ptr<const ECS::SnapshotFrame<ECS::LocalToWorld>> Acquire() const {
+            return _snapshot.Acquire();
+        }
+
+        [[nodiscard]] uint64_t GetNumExtracted() const noexcept { return _numExtracted; }
+        [[nodiscard]] size_t   GetNumVisible() const noexcept { return _numVisible; }
+
+    private:
+        void Extract(std::stop_token stop) {
+            uint64_t last = 0;
+            while (false == stop.stop_requested()) {
+                const auto frame = _snapshot.Acquire();
+                if (nullptr == frame || last == frame->GetFrame()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                last = frame->GetFrame();
+
+                size_t numVisible = 0;
+                frame->Each([&numVisible](ECS::Entity, const ECS::LocalToWorld& world) {
+                    numVisible += 0.0f < world.value[3].y;
+                });
+                _numVisible = numVisible;
+                ++_numExtracted;
+            }
+        }
+
+        ECS::Snapshot<ECS::LocalToWorld> _snapshot;
+        std::atomic<uint64_t>            _numExtracted = 0;
+        std::atomic<size_t>              _numVisible = 0;
+        // Last, so it is stopped before the snapshot goes away.
+        std::jthread                     _thread;
+    };
+
+    //=================================================================================================================
+    // Entities of a published frame within NearRadius of the origin, counted on chunk jobs.
+    //=================================================================================================================
+    constexpr float NearRadius = 500.0f;
+
+    ECS::AsyncTask CountNearOrigin(ECS::JobSystem& jobs, std::shared_ptr<const ECS::SnapshotFrame<ECS::LocalToWorld>> frame, std::atomic<size_t>& result) {
+        std::atomic<size_t> count = 0;
+        co_await jobs.Schedule(frame->GetNumChunks(), 4, [&frame, &count](size_t begin, size_t end) {
+            size_t local = 0;
+            frame->EachChunk(begin, end, [&local](std::span<const ECS::Entity>, std::span<const ECS::LocalToWorld> worlds) {
+                for (const auto& world : worlds) {
+                    const glm::vec3 position{ world.value[3] };
+                    local += glm::dot(position, position) < NearRadius * NearRadius ? 1 : 0;
+                }
+            });
+            count += local;
+        });
+        result = count.load();
+    }
+
+    //=================================================================================================================
+    // HierarchySystem : propagates LocalToWorld as an async task on the scheduler and keeps the time it took.
+    // A second task counts over the last published frame meanwhile; while either waits on its jobs the other
+    // schedules its own, so the workers and this thread take batches of both.
+    //=================================================================================================================
+    class HierarchySystem final {
+        using Clock = std::chrono::high_resolution_clock;
+
+    public:
+        HierarchySystem(ECS::TransformHierarchy& hierarchy, ECS::Scheduler& scheduler, const ExtractSystem& extractSystem)
+            : _hierarchy(hierarchy), _scheduler(scheduler), _extractSystem(extractSystem) {
+        }
+
+        void Run(ECS::Engine& ecsEngine, float) {
+            const auto start = Clock::now();
+            _scheduler.Start(_hierarchy.RunAsync(ecsEngine, _scheduler.GetJobSystem()));
+            if (auto frame = _extractSystem.Acquire()) {
+                _scheduler.Start(CountNearOrigin(_scheduler.GetJobSystem(), std::move(frame), _numNearOrigin));
+            }
+            _scheduler.RunFrame();
+            _elapsed += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+            ++_frame;
+        }
+
+        [[nodiscard]] uint64_t PopAverageMicroseconds() noexcept {
+            const auto result = 0 == _frame ? 0 : _elapsed / _frame;
+            _elapsed = _frame = 0;
+            return result;
+        }
+
+        [[nodiscard]] size_t GetNumNearOrigin() const noexcept { return _numNearOrigin; }
+
+    private:
+        ECS::TransformHierarchy& _hierarchy;
+        ECS::Scheduler&          _scheduler;
+        const ExtractSystem&     _extractSystem;
+        std::atomic<size_t>      _numNearOrigin = 0;
+        uint64_t                 _elapsed = 0;
+        uint64_t                 _frame = 0;
+    };
+
+    struct Bounds {
+        glm::vec3 min{ std::numeric_limits<float>::max() };
+        glm::vec3 max{ std::numeric_limits<float>::lowest() };
+    };
+
+    class PrintScreenSystem final {
+    public:
+        PrintScreenSystem(const Util::Timer& timer, float interval, const ECS::TransformHierarchy& hierarchy, ECS::JobSystem& jobs,
+                          HierarchySystem& hierarchySystem, const ExtractSystem& extractSystem)
+            : _timer(timer), _interval(interval)
+            , _hierarchy(hierarchy), _jobs(jobs), _hierarchySystem(hierarchySystem), _extractSystem(extractSystem) {
+        }
+
+        void Run(ECS::Engine& ecsEngine, float delta) {
+            _checkTime -= delta;
+            if(0.0f < _checkTime) {
+                return;
+            }
+            _checkTime += _interval;
+
+            system("cls");
+
+            fmt::print("Total entity count  : {}\n", ecsEngine.GetNumTotalEntity());
+            fmt::print("Total time          : {}\n", _timer.Total());
+            fmt::print("FPS                 : {}\n", _timer.Frame());
+            fmt::print("Threads             : {}\n", _jobs.GetNumThreads());
+            fmt::print("Max depth           : {}\n", _hierarchy.GetMaxDepth());
+            fmt::print("Updated per frame   : {}\n", _hierarchy.GetNumUpdated());
+            fmt::print("Hierarchy (us)      : {}\n", _hierarchySystem.PopAverageMicroseconds());
+            fmt::print("Extracted frames    : {}\n", _extractSystem.GetNumExtracted());
+            fmt::print("Extracted above y=0 : {}\n", _extractSystem.GetNumVisible());
+            fmt::print("Near origin (prev)  : {}\n", _hierarchySystem.GetNumNearOrigin());
+
+            const auto bounds = GetWorldBounds(ecsEngine);
+            fmt::print("World bounds        : ({}, {}, {}) - ({}, {}, {})\n", bounds.min.x, bounds.min.y, bounds.min.z, bounds.max.x, bounds.max.y, bounds.max.z);
+        }
+
+    private:
+        [[nodiscard]] Bounds GetWorldBounds(ECS::Engine& ecsEngine) {
+            if (false == _worlds.has_value() || &_worlds->GetEngine() != &ecsEngine) {
+                _worlds.emplace(ecsEngine);
+            }
+
+            return _worlds->Reduce(_jobs, Bounds{}, [](Bounds& bounds, const ECS::QueryChunk&, std::span<const ECS::LocalToWorld> worlds) {
+                for (const auto& world : worlds) {
+                    bounds.min = glm::min(bounds.min, glm::vec3{ world.value[3] });
+                    bounds.max = glm::max(bounds.max, glm::vec3{ world.value[3] });
+                }
+            }, [](Bounds& bounds, const Bounds& other) {
+                bounds.min = glm::min(bounds.min, other.min);
+                bounds.max = glm::max(bounds.max, other.max);
+            });
+        }
+
+        const Util::Timer&             _timer;
+        const float                    _interval;
+        float                          _checkTime = 0.0f;
+        const ECS::TransformHierarchy& _hierarchy;
+        ECS::JobSystem&                _jobs;
+        HierarchySystem&               _hierarchySystem;
+        const ExtractSystem&           _extractSystem;
+        std::optional<ECS::Query<const ECS::LocalToWorld>> _worlds;
+    };
+
+    class SpinSystem final : public ECS::StaticSystem<SpinSystem, ECS::LocalToParent> {
+    public:
+        static void Configure(QueryType& query) {
+            query.With<SpinTag>();
+        }
+
+        __inline void ForEach(float delta, ECS::LocalToParent& local) const {
+            local.value = glm::rotate(local.value, delta, Math::Vec3::AxisY);
+        }
+    };
+
+    // Random::Distribution works on unsigned ranges, so the offset is drawn from [0, 2 * range] and centered.
+    [[nodiscard]] glm::mat4 RandomOffset(float range) {
+        return glm::translate(Math::Mat4::Identity, glm::vec3{
+            Util::Random::Distribution(0.0f, range * 2.0f) - range,
+            Util::Random::Distribution(0.0f, range * 2.0f) - range,
+            Util::Random::Distribution(0.0f, range * 2.0f) - range });
+    }
+
+    // Trees of NumLevels below the root with NumChildren per node, every SpinInterval-th root spins.
+    void CreateEntities(ECS::Engine& ecsEngine, ECS::TransformHierarchy& hierarchy, uint32_t count) {
+        const auto hashes = ArchType::GetHashes(false);
+        const auto spinHashes = ArchType::GetHashes(true);
+        const auto localHash = ECS::TypeHash<ECS::LocalToParent>();
+
+        uint32_t numPerTree = 1;
+        for (uint32_t level = 0, width = 1; level < NumLevels; ++level) {
+            width *= NumChildren;
+            numPerTree += width;
+        }
+
+        ECS::Entities parents, children;
+        for (uint32_t tree = 0; tree < count / numPerTree; ++tree) {
+            const auto root = ecsEngine.CreateEntity(0 == tree % SpinInterval ? spinHashes : hashes);
+            ecsEngine.Accept<ECS::LocalToParent>(root, localHash)->value = RandomOffset(1000.0f);
+
+            parents.assign(1, root);
+            for (uint32_t level = 0; level < NumLevels; ++level) {
+                children.clear();
+                for (const auto parent : parents) {
+                    for (uint32_t i = 0; i < NumChildren; ++i) {
+                        const auto child = ecsEngine.CreateEntity(hashes);
+                        hierarchy.SetParent(ecsEngine, child, parent);
+                        ecsEngine.Accept<ECS::LocalToParent>(child, localHash)->value = RandomOffset(10.0f);
+                        children.emplace_back(child);
+                    }
+                }
+                std::swap(parents, children);
+            }
+        }
+    }
+}
+
+namespace Scenario {
+    ScenarioHierarchyECS::ScenarioHierarchyECS() {
+        fmt::print("Start hierarchy ecs scenario.\n");
+
+        ECS::Engine ecsEngine;
+        ecsEngine.RegistryTypeInformation(ArchType::GetHashSizePairs(false), ECS::TransformHierarchy::GetHeaderDesc());
+        ecsEngine.RegistryTypeInformation(ArchType::GetHashSizePairs(true), ECS::TransformHierarchy::GetHeaderDesc());
+
+        ECS::TransformHierarchy hierarchy;
+        CreateEntities(ecsEngine, hierarchy, NumEntities); {
+            Util::Timer timer;
+            ECS::JobSystem jobs;
+            ECS::Scheduler scheduler(jobs);
+
+            SpinSystem spinSystem;
+            ExtractSystem extractSystem(ecsEngine);
+            HierarchySystem hierarchySystem(hierarchy, scheduler, extractSystem);
+            PrintScreenSystem printScreenSystem(timer, 1.0f, hierarchy, jobs, hierarchySystem, extractSystem);
+
+            ECS::World world(ecsEngine, printScreenSystem, spinSystem, hierarchySystem, extractSystem);
+
+            while(60.0f > timer.Total()) {
+                timer.Update();
+                world.Run(timer.Delta());
+            }
+        }
+    }
+
+    ScenarioHierarchyECS::~ScenarioHierarchyECS() {
+        fmt::print("End hierarchy ecs scenario.\n");
+        fmt::print("Press any key to end...\n");
+        (void)_getch();
+    }
+}
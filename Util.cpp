@@ -12,7 +12,7 @@ namespace Util {
 
     void Timer::Update() {
         const auto now = Clock::now();
-        _delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - _prev).count() * 0.001f;
+        _delta = std::chrono::duration<float>(now - _prev).count();
         _prev = now;
 
         _total += _delta;
@@ -9,7 +9,7 @@ namespace {
         const auto indices = Scenario::GetIndices();
 
         while (true) {
-            fmt::print("\nSelect scenario mode.\n1. No chunk.\n2. Chunk.\n:");
+            fmt::print("\nSelect scenario mode.\n1. No chunk.\n2. Chunk.\n3. Chunk random access.\n4. Transform hierarchy.\n:");
 
             std::string buffer;
             std::getline(std::cin, buffer);
@@ -4,7 +4,10 @@
 
 #include <conio.h>
 
+#include <array>
+#include <bit>
 #include <map>
+#include <memory>
 #include <unordered_set>
 #include <unordered_map>
 #include <ranges>
@@ -13,7 +16,14 @@
 #include <chrono>
 #include <random>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
 #include <deque>
+#include <functional>
+#include <span>
+#include <optional>
 #include <ranges>
 
 #define FMT_HEADER_ONLY